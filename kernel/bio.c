@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,6 +12,14 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+//
+// Each hash bucket has its own lock, which protects the
+// chain and the refcnt and identity of the buffers on it, so
+// lookups on different CPUs rarely meet. A miss recycles an
+// unused buffer found by a clock hand sweeping all buffers,
+// which skips the ones used since it last passed; it takes one
+// bucket lock at a time. The number of buffers is set at boot
+// from the amount of free memory.
 
 
 #include "types.h"
@@ -22,72 +30,200 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "vmstat.h"
 
-struct {
+#define NBUCKET 61
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;
+  // counters, for bcachestat().
+  uint64 hits;
+  uint64 misses;
+};
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+struct {
+  struct buf *buf;
+  int nbuf;
+  uint hand;  // clock hand, advanced atomically
+
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+static int
+hash(uint dev, uint blockno)
+{
+  return (dev * 31 + blockno) % NBUCKET;
+}
+
+// Smallest order of a block of pages holding n bytes.
+static int
+order(uint64 n)
+{
+  int k = 0;
+
+  while((PGSIZE << k) < n)
+    k++;
+  return k;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  uchar *data = 0;
+  int i, n, k;
+
+  // as many buffers as fit in the cache's share of free memory,
+  // as long as their headers fit in the largest kalloc_pages().
+  n = kfreepages() / BCACHE_SHARE * (PGSIZE / BSIZE);
+  if(n > NBUF_MAX)
+    n = NBUF_MAX;
+  if(n < NBUF)
+    n = NBUF;
+  while((k = order(n * sizeof(struct buf))) >= KORDERS)
+    n /= 2;
+  if((bcache.buf = kalloc_pages(k)) == 0)
+    panic("binit");
+  bcache.nbuf = n;
 
-  initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache");
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  for(i = 0; i < n; i++){
+    b = &bcache.buf[i];
+    if(i % (PGSIZE / BSIZE) == 0 && (data = kalloc_nofill()) == 0)
+      panic("binit: data");
+    b->data = data + (i % (PGSIZE / BSIZE)) * BSIZE;
+    // a block no lookup matches.
+    b->dev = -1;
+    b->blockno = -1;
+    b->valid = 0;
+    b->refcnt = 0;
+    b->used = 0;
+    b->bucket = i % NBUCKET;
+    b->next = bcache.bucket[b->bucket].head;
+    bcache.bucket[b->bucket].head = b;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
   }
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Find block blockno of dev in bucket h, and take a reference.
+// Caller must hold the bucket's lock.
 static struct buf*
-bget(uint dev, uint blockno)
+blookup(struct bucket *h, uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = h->head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+      b->used = 1;
       return b;
     }
   }
+  return 0;
+}
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+// Take b off the chain of bucket h.
+// Caller must hold the bucket's lock.
+static void
+bunlink(struct bucket *h, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &h->head; *pp != b; pp = &(*pp)->next)
+    ;
+  *pp = b->next;
+}
+
+// Sweep the clock hand to an unused buffer, and take it off
+// its bucket with a reference, so that no one else can.
+static struct buf*
+bvictim(void)
+{
+  struct bucket *h;
+  struct buf *b;
+  int i;
+
+  for(i = 0; i < 3*bcache.nbuf; i++){
+    b = &bcache.buf[__sync_fetch_and_add(&bcache.hand, 1) % bcache.nbuf];
+    if(b->refcnt)
+      continue;
+    h = &bcache.bucket[b->bucket];
+    acquire(&h->lock);
+    if(b->refcnt == 0){
+      // b may have moved to another bucket meanwhile; see
+      // bget() for the order of the stores.
+      __sync_synchronize();
+      if(h != &bcache.bucket[b->bucket]){
+        release(&h->lock);
+        continue;
+      }
+      if(!b->used){
+        bunlink(h, b);
+        b->refcnt = 1;
+        release(&h->lock);
+        return b;
+      }
+      b->used = 0;
     }
+    release(&h->lock);
   }
   panic("bget: no buffers");
 }
 
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct bucket *h = &bcache.bucket[hash(dev, blockno)];
+  struct buf *b, *v;
+
+  acquire(&h->lock);
+
+  // Is the block already cached?
+  if((b = blookup(h, dev, blockno)) != 0){
+    h->hits++;
+    release(&h->lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  h->misses++;
+  release(&h->lock);
+
+  // Not cached.
+  // Recycle a buffer the clock hand finds unused.
+  v = bvictim();
+
+  acquire(&h->lock);
+  if((b = blookup(h, dev, blockno)) == 0){
+    b = v;
+    b->dev = dev;
+    b->blockno = blockno;
+    b->used = 1;
+  } else {
+    // cached by someone else meanwhile; v holds nothing.
+    v->dev = -1;
+    v->blockno = -1;
+  }
+  v->valid = 0;
+  v->bucket = h - bcache.bucket;
+  v->next = h->head;
+  h->head = v;
+  if(b != v){
+    // bvictim() may take v as soon as refcnt is 0, so the
+    // new bucket must be visible first.
+    __sync_synchronize();
+    v->refcnt = 0;
+  }
+  release(&h->lock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
 // Return a locked buf with the contents of the indicated block.
 struct buf*
 bread(uint dev, uint blockno)
@@ -111,43 +247,125 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Start writing b's contents to disk, without waiting.
+// b must stay locked until bwait(b). Writes started one
+// after another reach the device together.
+void
+bwrite_start(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwrite_start");
+  virtio_disk_submit(b, 1);
+}
+
+// Wait for the write started on b by bwrite_start().
+void
+bwait(struct buf *b)
+{
+  virtio_disk_wait(&b->disk);
+}
+
+// Start writing the locked bufs bs[0..n-1] to disk, each to
+// block blockno[i] of its device, or to its own block if
+// blockno is 0, without waiting. The cached copies of the
+// blocks written to are not updated. Each run of consecutive
+// blocks goes to the disk as one request, of up to DISK_NSEG
+// blocks.
+void
+bwrite_startat(struct buf **bs, uint *blockno, int n)
+{
+  uint bn[DISK_NSEG];
+  int i, j;
+
+  for(i = 0; i < n; i = j){
+    for(j = i; j < n && j-i < DISK_NSEG; j++){
+      if(!holdingsleep(&bs[j]->lock))
+        panic("bwrite_startat");
+      bn[j-i] = blockno ? blockno[j] : bs[j]->blockno;
+      if(j > i && (bs[j]->dev != bs[i]->dev || bn[j-i] != bn[0] + (j-i)))
+        break;
+    }
+    virtio_disk_submitv(&bs[i], j-i, bn[0], 1);
+  }
+}
+
+// Start writing the locked bufs bs[0..n-1], without waiting.
+void
+bwrite_startv(struct buf **bs, int n)
+{
+  bwrite_startat(bs, 0, n);
+}
+
+// Wait for the writes started by bwrite_startv(bs, n)
+// or bwrite_startat(bs, blockno, n).
+void
+bwaitv(struct buf **bs, int n)
+{
+  int i;
+
+  // a request is done once the busy flag of its first buf is
+  // clear; the rest were never set.
+  for(i = 0; i < n; i++)
+    virtio_disk_wait(&bs[i]->disk);
+}
+
+// Write the locked bufs bs[0..n-1] to disk.
+void
+bwritev(struct buf **bs, int n)
+{
+  bwrite_startv(bs, n);
+  bwaitv(bs, n);
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Mark it used, so the clock hand passes it over once.
 void
 brelse(struct buf *b)
 {
+  struct bucket *h;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  // b stays in its bucket while it has references.
+  h = &bcache.bucket[b->bucket];
+  acquire(&h->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  b->used = 1;
+  release(&h->lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *h = &bcache.bucket[b->bucket];
+
+  acquire(&h->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&h->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *h = &bcache.bucket[b->bucket];
+
+  acquire(&h->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&h->lock);
 }
 
+// Fill in the buffer cache counters of st.
+void
+bcachestat(struct vmstat *st)
+{
+  struct bucket *h;
 
+  st->nbuf = bcache.nbuf;
+  st->bcache_hits = st->bcache_misses = st->bcache_contended = 0;
+  for(h = bcache.bucket; h < &bcache.bucket[NBUCKET]; h++){
+    st->bcache_hits += h->hits;
+    st->bcache_misses += h->misses;
+    st->bcache_contended += h->lock.ncontended;
+  }
+}
@@ -5,8 +5,9 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
-  uchar data[BSIZE];
+  int bucket;       // hash bucket b is in
+  int used;         // used since the clock hand last passed?
+  struct buf *next; // hash chain
+  uchar *data;      // BSIZE bytes
 };
 
@@ -8,16 +8,35 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
-struct storedpage;
 struct page_access_info;
+struct vmstat;
+struct kmem_cache;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwrite_start(struct buf*);
+void            bwait(struct buf*);
+void            bwrite_startv(struct buf**, int);
+void            bwrite_startat(struct buf**, uint*, int);
+void            bwaitv(struct buf**, int);
+void            bwritev(struct buf**, int);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            bcachestat(struct vmstat*);
+
+// swap.c
+void            swapinit(int, struct superblock*);
+int             swapalloc(void);
+void            swapdup(int);
+void            swapfree(int);
+int             swaprefs(int);
+void            swapread(char*, int);
+void            swapread_batch(char**, int*, int);
+void            swapwrite(char*, int);
+void            swapstat(struct vmstat*);
 
 // console.c
 void            consoleinit(void);
@@ -35,8 +54,6 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
-int             kfileread(struct file*, uint64, int n);
-int             kfilewrite(struct file*, uint64, int n);
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
@@ -56,10 +73,6 @@ int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
-int		        createSwapFile(struct proc* p);
-int	          	readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size);
-int		        writeToSwapFile(struct proc* p, char* buffer, uint placeOnFile, uint size);
-int		        removeSwapFile(struct proc* p);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -68,16 +81,36 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_nofill(void);
+void*           kalloc_zeroed(void);
+void*           kalloc_pages(int);
+void            kfree_pages(void*, int);
+int             kfreepages(void);
+void            kdup(void*);
+int             krefs(void*);
 void            kfree(void *);
 void            kinit(void);
+void            kallocstat(struct vmstat*);
+void            kzeroinit(void);
+
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, int);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void            slabstat(struct vmstat*);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+void            begin_opn(int);
 void            end_op(void);
+void            end_opn(int);
+int             log_maxop(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -112,10 +145,29 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
-pte_t*          find_page_to_store(uint64*);
-int             load_page(uint64 va);
-int             store_page(pte_t *pte, uint64 page_address);
-uint64          get_next_turn(struct proc*);
+struct page_access_info* find_page_to_store(struct proc*);
+int             load_page(struct proc*, uint64 va);
+int             store_page(struct proc*, struct page_access_info*);
+int             alloc_slot(struct proc*);
+void            free_slot(struct proc*, int);
+int             reserve_ram_page(struct proc*);
+void            add_ram_page(struct proc*, uint64, pte_t*, int);
+void            remove_ram_page(struct proc*, struct page_access_info*);
+void            remove_pages(struct proc*, uint64, uint64);
+int             copy_pages(struct proc*, struct proc*);
+void            reset_pages(struct proc*);
+int             swapping(struct proc*);
+int             free_ram_slots(struct proc*);
+int             setrss(struct proc*, int);
+int             setpolicy(struct proc*, char*);
+char*           policyname(struct proc*);
+int             evict_page(struct proc*);
+int             swap_in(struct proc*, uint64);
+void            preempt(void);
+void            pageoutinit(void);
+void            kthread_create(void (*)(void), char*, int);
+int             getvmstat(int, uint64);
+int             getvmstats(uint64, int);
 
 
 // swtch.S
@@ -175,7 +227,7 @@ void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
-int             mapdiskpages(pagetable_t, uint64, int);
+int             mapdiskpages(pagetable_t, uint64, pte_t);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
@@ -185,7 +237,9 @@ void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 uint64          walkaddr(pagetable_t, uint64);
+void            uvmfaultin(pagetable_t, uint64, uint64);
 pte_t*          walk(pagetable_t , uint64 , int );
+int             cow_fault(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
@@ -199,6 +253,13 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_start(uint, void*, uint, int, int*);
+void            virtio_disk_startv(uint, void**, int, uint, int, int*);
+void            virtio_disk_submit(struct buf *, int);
+void            virtio_disk_submitv(struct buf **, int, uint, int);
+void            virtio_disk_kick(void);
+void            virtio_disk_wait(int*);
+void            virtio_disk_rwpage(uint, char*, int);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -206,4 +267,5 @@ void            virtio_disk_intr(void);
 #define SCFIFO 1
 #define NFUA 2
 #define LAPA 3
-#define NONE 4
\ No newline at end of file
+#define NONE 4
+#define CLOCKPRO 5
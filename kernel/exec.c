@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
@@ -108,25 +109,14 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
-  struct storedpage* spage;
-  for(spage = p->storedpages; spage < &p->storedpages[MAX_TOTAL_PAGES]; spage++){
-    spage->in_use = 0;
-  }
-
-  struct page_access_info* pi;
-  p->page_turn = 0;
-  for(pi=p->ram_pages; pi<&p->ram_pages[MAX_PSYC_PAGES]; pi++){
-    pi->loaded_at = 0;
-    pi->access_counter = 0;
-    pi->in_use = 0;
-    if (SELECTION == LAPA)
-      pi->access_counter = 4294967295;  
-  }
-
-  // Commit to the user image.
+  // Commit to the user image, which starts out
+  // with none of its pages tracked for paging.
+  acquiresleep(&p->swap_lock);
+  reset_pages(p);
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
   p->sz = sz;
+  releasesleep(&p->swap_lock);
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
@@ -1,6 +1,22 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or with kalloc_pages() blocks of 2^order pages.
+//
+// The global pool is a buddy allocator: a free block of
+// 2^k pages starts at a multiple of 2^k pages from KERNBASE,
+// and is merged with its buddy, the other half of the block
+// of 2^(k+1) pages, as soon as both are free.
+//
+// Single pages are kept on one list per CPU, so CPUs that
+// allocate and free at the same time rarely share a lock.
+// A CPU whose list runs dry refills KBATCH pages from the
+// pool, or failing that steals half of another CPU's list;
+// one whose list grows past 2*KBATCH gives KBATCH pages
+// back to the pool.
+//
+// A low-priority kernel thread, kzerod, keeps up to NZERO
+// zero-filled pages aside on idle CPUs, for kalloc_zeroed().
 
 #include "types.h"
 #include "param.h"
@@ -8,6 +24,10 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "vmstat.h"
+
+#define KBATCH 32  // pages moved to or from the pool at once
+#define NZERO  64  // pre-zeroed pages kzerod keeps
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -16,17 +36,58 @@ extern char end[]; // first address after kernel.
 
 struct run {
   struct run *next;
+  struct run *prev;  // in the pool only
 };
 
-struct {
+// A list of single pages.
+struct kmem {
   struct spinlock lock;
   struct run *freelist;
+  int nfree;
+  // counters, for kallocstat().
+  uint64 refills;  // batches taken from the pool
+  uint64 steals;   // batches taken from another CPU
+  uint64 spills;   // batches given back to the pool
+};
+
+struct kmem kcpu[NCPU];   // per-CPU lists
+struct kmem kzero;        // pre-zeroed pages
+
+// The global pool.
+struct {
+  struct spinlock lock;
+  struct run *free[KORDERS];  // free blocks of each order
+  int nblock[KORDERS];        // how many
+  int nfree;                  // free pages in all of them
 } kmem;
 
+// counters, for kallocstat().
+uint64 kzero_hits;        // kalloc_zeroed() calls served from kzero
+uint64 kzero_misses;      // calls that had to zero a page
+
+// Pages shared copy-on-write are freed when the last
+// reference goes. References are counted with atomic
+// operations, so no lock protects them.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
+#define REF2PA(i) (KERNBASE + (uint64)(i) * PGSIZE)
+#define NPAGE PA2REF(PHYSTOP)
+
+int kref[NPAGE];
+
+// 1 + order of the free block in the pool starting
+// at each page, or 0. Protected by kmem.lock.
+uchar korder[NPAGE];
+
 void
 kinit()
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kcpu[i].lock, "kmem_cpu");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,48 +96,423 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kref[PA2REF(p)] = 1;
     kfree(p);
+  }
+}
+
+// Put block r of 2^k pages on the pool's free list.
+static void
+bpush(struct run *r, int k)
+{
+  r->prev = 0;
+  r->next = kmem.free[k];
+  if(r->next)
+    r->next->prev = r;
+  kmem.free[k] = r;
+  kmem.nblock[k]++;
+  korder[PA2REF(r)] = k + 1;
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
+// Take block r of 2^k pages off the pool's free list.
+static void
+bunlink(struct run *r, int k)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.free[k] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.nblock[k]--;
+  korder[PA2REF(r)] = 0;
+}
+
+// Allocate a block of 2^order pages from the pool,
+// splitting a larger one if need be.
+// Caller must hold kmem.lock.
+static struct run*
+balloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k < KORDERS && kmem.free[k] == 0; k++)
+    ;
+  if(k == KORDERS)
+    return 0;
+  r = kmem.free[k];
+  bunlink(r, k);
+  // give back the upper halves.
+  while(k > order){
+    k--;
+    bpush((struct run*)((char*)r + (PGSIZE << k)), k);
+  }
+  kmem.nfree -= 1 << order;
+  return r;
+}
+
+// Return a block of 2^order pages to the pool, merging
+// it with its buddy for as long as that is free too.
+// Caller must hold kmem.lock.
+static void
+bfree(struct run *r, int order)
+{
+  uint64 i = PA2REF(r), b;
+
+  kmem.nfree += 1 << order;
+  for(; order < KORDERS-1; order++){
+    b = i ^ (1UL << order);
+    if(b >= NPAGE || korder[b] != order + 1)
+      break;
+    bunlink((struct run*)REF2PA(b), order);
+    i &= ~(1UL << order);
+  }
+  bpush((struct run*)REF2PA(i), order);
+}
+
+// Move up to n pages from the list of from to that of to,
+// and return how many. Caller must hold the locks of both,
+// if they are shared.
+static int
+kmove(struct kmem *from, struct kmem *to, int n)
+{
+  struct run *r;
+  int i;
+
+  for(i = 0; i < n && (r = from->freelist) != 0; i++){
+    from->freelist = r->next;
+    r->next = to->freelist;
+    to->freelist = r;
+  }
+  from->nfree -= i;
+  to->nfree += i;
+  return i;
+}
+
+// Refill the empty list of CPU c, from the pool
+// or from another CPU. Takes one lock at a time.
+// Caller must have interrupts off, and not hold c->lock.
+static void
+krefill(struct kmem *c)
+{
+  struct kmem batch = { .freelist = 0, .nfree = 0 };
+  struct kmem *k;
+  struct run *r;
+  int steal = 0;
+
+  acquire(&kmem.lock);
+  while(batch.nfree < KBATCH && (r = balloc(0)) != 0){
+    r->next = batch.freelist;
+    batch.freelist = r;
+    batch.nfree++;
+  }
+  release(&kmem.lock);
+  for(k = kcpu; batch.nfree == 0 && k < &kcpu[NCPU]; k++){
+    if(k == c || k->nfree == 0)
+      continue;
+    acquire(&k->lock);
+    kmove(k, &batch, (k->nfree + 1) / 2);
+    release(&k->lock);
+    steal = 1;
+  }
+  if(batch.nfree == 0)
+    return;
+
+  acquire(&c->lock);
+  kmove(&batch, c, batch.nfree);
+  if(steal)
+    c->steals++;
+  else
+    c->refills++;
+  release(&c->lock);
+}
+
+// Return the pages on list l to the pool.
+static void
+kspill(struct kmem *l)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while((r = l->freelist) != 0){
+    l->freelist = r->next;
+    bfree(r, 0);
+  }
+  l->nfree = 0;
+  release(&kmem.lock);
+}
+
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The page is freed with its last reference.
 void
 kfree(void *pa)
 {
+  struct kmem batch = { .freelist = 0, .nfree = 0 };
+  struct kmem *c;
   struct run *r;
+  int ref;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if((ref = __sync_fetch_and_sub(&kref[PA2REF(pa)], 1)) <= 0)
+    panic("kfree: free page");
+  if(ref > 1)
+    return;
+
   // Fill with junk to catch dangling refs.
-  memset(pa, 1, PGSIZE);
+  if(KALLOC_POISON)
+    memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  c = &kcpu[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->nfree++;
+  if(c->nfree > 2*KBATCH){
+    kmove(c, &batch, KBATCH);
+    c->spills++;
+  }
+  release(&c->lock);
+
+  if(batch.nfree)
+    kspill(&batch);
+  pop_off();
 }
 
-// Allocate one 4096-byte page of physical memory.
+// Take a page off the list of CPU c, or return 0.
+static struct run*
+kpop(struct kmem *c)
+{
+  struct run *r;
+
+  acquire(&c->lock);
+  if((r = c->freelist) != 0){
+    c->freelist = r->next;
+    c->nfree--;
+  }
+  release(&c->lock);
+  return r;
+}
+
+// Allocate one 4096-byte page of physical memory,
+// for a caller that overwrites all of it.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 void *
+kalloc_nofill(void)
+{
+  struct kmem *c;
+  struct run *r;
+
+  push_off();
+  c = &kcpu[cpuid()];
+  if((r = kpop(c)) == 0){
+    krefill(c);
+    r = kpop(c);
+  }
+  pop_off();
+  // the last free pages may have been zeroed.
+  if(r == 0)
+    r = kpop(&kzero);
+
+  if(r)
+    kref[PA2REF(r)] = 1;
+  return (void*)r;
+}
+
+// Allocate one 4096-byte page of physical memory,
+// with unspecified contents.
+// Returns 0 if the memory cannot be allocated.
+void *
 kalloc(void)
+{
+  char *r;
+
+  if((r = kalloc_nofill()) != 0 && KALLOC_POISON)
+    memset(r, 5, PGSIZE); // fill with junk
+  return (void*)r;
+}
+
+// Allocate one zero-filled page of physical memory.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  char *r;
+
+  if((r = (char*)kpop(&kzero)) != 0){
+    kref[PA2REF(r)] = 1;
+    __sync_fetch_and_add(&kzero_hits, 1);
+    return (void*)r;
+  }
+  __sync_fetch_and_add(&kzero_misses, 1);
+  if((r = kalloc_nofill()) != 0)
+    memset(r, 0, PGSIZE);
+  return (void*)r;
+}
+
+// Fill the pool of zeroed pages, one page per run, while
+// memory is plentiful. Runs at low priority, so only on
+// CPUs with nothing else to do; once the pool is full it
+// looks again every tick.
+static void
+kzerod(void)
+{
+  struct run *r;
+
+  for(;;){
+    if(kzero.nfree >= NZERO || kfreepages() < 4*NZERO ||
+       (r = kalloc_nofill()) == 0){
+      acquire(&tickslock);
+      sleep(&ticks, &tickslock);
+      release(&tickslock);
+      continue;
+    }
+    memset(r, 0, PGSIZE);
+    kref[PA2REF(r)] = 0;
+    acquire(&kzero.lock);
+    r->next = kzero.freelist;
+    kzero.freelist = r;
+    kzero.nfree++;
+    release(&kzero.lock);
+    yield();
+  }
+}
+
+void
+kzeroinit(void)
+{
+  kthread_create(kzerod, "kzerod", 1);
+}
+
+// Give the single pages cached on every CPU back to the
+// pool, so that they can merge into larger blocks.
+static void
+kdrain(void)
+{
+  struct kmem batch = { .freelist = 0, .nfree = 0 };
+  struct kmem *c;
+
+  for(c = kcpu; c < &kcpu[NCPU]; c++){
+    acquire(&c->lock);
+    kmove(c, &batch, c->nfree);
+    release(&c->lock);
+  }
+  kspill(&batch);
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their size. Returns 0 if they cannot be allocated.
+void *
+kalloc_pages(int order)
 {
   struct run *r;
+  int i;
+
+  if(order < 0 || order >= KORDERS)
+    return 0;
+  if(order == 0)
+    return kalloc();
 
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  r = balloc(order);
   release(&kmem.lock);
-
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+  if(r == 0){
+    kdrain();
+    acquire(&kmem.lock);
+    r = balloc(order);
+    release(&kmem.lock);
+  }
+  if(r == 0)
+    return 0;
+  for(i = 0; i < (1 << order); i++)
+    kref[PA2REF(r) + i] = 1;
+  if(KALLOC_POISON)
+    memset(r, 5, PGSIZE << order); // fill with junk
   return (void*)r;
 }
+
+// Free the 2^order pages at pa, which must have come
+// from kalloc_pages(order) and must not be shared.
+void
+kfree_pages(void *pa, int order)
+{
+  int i;
+
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if(order < 0 || order >= KORDERS || (char*)pa < end ||
+     PA2REF(pa) % (1 << order) != 0 || (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_pages");
+  for(i = 0; i < (1 << order); i++){
+    if(kref[PA2REF(pa) + i] != 1)
+      panic("kfree_pages: ref");
+    kref[PA2REF(pa) + i] = 0;
+  }
+  if(KALLOC_POISON)
+    memset(pa, 1, PGSIZE << order);
+
+  acquire(&kmem.lock);
+  bfree((struct run*)pa, order);
+  release(&kmem.lock);
+}
+
+// Number of free pages. Only a hint: it may change
+// as soon as it is returned.
+int
+kfreepages(void)
+{
+  int i, n = kmem.nfree + kzero.nfree;
+
+  for(i = 0; i < NCPU; i++)
+    n += kcpu[i].nfree;
+  return n;
+}
+
+// Add a reference to an allocated page, to share it.
+void
+kdup(void *pa)
+{
+  if(__sync_fetch_and_add(&kref[PA2REF(pa)], 1) <= 0)
+    panic("kdup");
+}
+
+// Number of references to an allocated page.
+int
+krefs(void *pa)
+{
+  return kref[PA2REF(pa)];
+}
+
+// Add up the allocator's counters into st.
+void
+kallocstat(struct vmstat *st)
+{
+  int i;
+
+  st->free_pages = kfreepages();
+  st->kalloc_refills = st->kalloc_steals = st->kalloc_spills = 0;
+  st->kalloc_contended = kmem.lock.ncontended;
+  st->zeroed_pages = kzero.nfree;
+  st->zeroed_hits = kzero_hits;
+  st->zeroed_misses = kzero_misses;
+  for(i = 0; i < KORDERS; i++)
+    st->free_blocks[i] = kmem.nblock[i];
+  for(i = 0; i < NCPU; i++){
+    st->kalloc_refills += kcpu[i].refills;
+    st->kalloc_steals += kcpu[i].steals;
+    st->kalloc_spills += kcpu[i].spills;
+    st->kalloc_contended += kcpu[i].lock.ncontended;
+  }
+}
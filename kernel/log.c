@@ -4,6 +4,7 @@
 #include "param.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "proc.h"
 #include "fs.h"
 #include "buf.h"
 
@@ -19,192 +20,313 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the log thread has committed. Calls that may
+// write many blocks, like large write()s, reserve more room
+// with begin_opn()/end_opn().
+//
+// Commits are done by a kernel thread, logd. A call that logged
+// blocks returns from end_op() once the transaction holding
+// them is on disk, so the calls that end while a commit is on
+// its way share the next one (group commit).
 //
 // The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
+// It has two halves, which transactions use in turn, so that
+// logd can install one transaction at the home locations
+// while the next one gathers updates. mkfs sets the size of
+// the log, up to LOGMAX blocks per half. The on-disk format of
+// each half:
 //   header block, containing block #s for block A, B, C, ...
 //   block A
 //   block B
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// Blocks go to the log straight from their cache copies, which
+// logd keeps locked until they are installed, so calls of the
+// next transaction that need one of them wait for that. The
+// log blocks themselves are never read through the cache
+// after recovery.
+
+#define LOGMAX (BSIZE/sizeof(int) - 2)  // blocks a header can name
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  int seq;  // which half's transaction is older, for recovery
+  int block[LOGMAX];
 };
 
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int size;        // blocks in each half, with its header
+  int cap;         // blocks a transaction may log
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // blocks they may still log
+  int committing;  // logd is writing the log, please wait.
   int dev;
-  struct logheader lh;
+  int cur;         // half that gathers the open transaction
+  int seq;         // sequence number of the open transaction
+  int durable;     // sequence number of the last one committed
+  struct logheader lh[2];
+  struct buf *lbuf[LOGMAX];  // bufs logd is writing
+  uint home[LOGMAX];         // where they go
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void logd(void);
 
 void
 initlog(int dev, struct superblock *sb)
 {
-  if (sizeof(struct logheader) >= BSIZE)
+  if (sizeof(struct logheader) > BSIZE)
     panic("initlog: too big logheader");
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
-  log.size = sb->nlog;
+  log.size = sb->nlog / 2;
   log.dev = dev;
+  log.cap = log.size - 1 < LOGMAX ? log.size - 1 : LOGMAX;
+  if (log.cap < 2*MAXOPBLOCKS)
+    panic("initlog: log too small");
   recover_from_log();
+  kthread_create(logd, "logd", 0);
 }
 
-// Copy committed blocks from log to their home location
+// Block number of the header of half h.
+static int
+logblock(int h)
+{
+  return log.start + h*log.size;
+}
+
+// Write the cache copies of the blocks of half h, which
+// logd holds locked, to their home location, and release them.
 static void
-install_trans(int recovering)
+install_trans(int h)
 {
-  int tail;
+  struct buf *b;
+  int n = log.lh[h].n;
+  int tail, i;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+  // sort by block number, so that neighbouring
+  // blocks go to the disk together.
+  for (tail = 1; tail < n; tail++) {
+    b = log.lbuf[tail];
+    for (i = tail; i > 0 && log.lbuf[i-1]->blockno > b->blockno; i--)
+      log.lbuf[i] = log.lbuf[i-1];
+    log.lbuf[i] = b;
+  }
+  bwritev(log.lbuf, n);  // write dst to disk
+  for (tail = 0; tail < n; tail++) {
+    bunpin(log.lbuf[tail]);
+    brelse(log.lbuf[tail]);
   }
 }
 
-// Read the log header from disk into the in-memory log header
+// Read the header of half h from disk into the in-memory log header
 static void
-read_head(void)
+read_head(int h)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bread(log.dev, logblock(h));
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  log.lh[h].n = lh->n;
+  log.lh[h].seq = lh->seq;
+  for (i = 0; i < log.lh[h].n; i++) {
+    log.lh[h].block[i] = lh->block[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
+// Write the in-memory header of half h to disk.
 // This is the true point at which the
 // current transaction commits.
 static void
-write_head(void)
+write_head(int h)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bread(log.dev, logblock(h));
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = log.lh[h].n;
+  hb->seq = log.lh[h].seq;
+  for (i = 0; i < log.lh[h].n; i++) {
+    hb->block[i] = log.lh[h].block[i];
   }
   bwrite(buf);
   brelse(buf);
 }
 
+// Install the committed transaction in half h, if any.
+static void
+recover_half(int h)
+{
+  int n = log.lh[h].n;
+  int tail;
+
+  // copy from log to disk.
+  for (tail = 0; tail < n; tail++) {
+    log.lbuf[tail] = bread(log.dev, logblock(h)+tail+1);
+    log.home[tail] = log.lh[h].block[tail];
+  }
+  bwrite_startat(log.lbuf, log.home, n);
+  bwaitv(log.lbuf, n);
+  for (tail = 0; tail < n; tail++)
+    brelse(log.lbuf[tail]);
+  log.lh[h].n = 0;
+  write_head(h); // clear the log
+}
+
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  int old;
+
+  read_head(0);
+  read_head(1);
+  // the older transaction goes first, as the newer one may
+  // overwrite the same blocks.
+  old = log.lh[1].n > 0 && (log.lh[0].n == 0 || log.lh[1].seq < log.lh[0].seq);
+  recover_half(old);
+  recover_half(!old);
+  log.seq = (log.lh[0].seq > log.lh[1].seq ? log.lh[0].seq : log.lh[1].seq) + 1;
+  log.durable = log.seq - 1;
 }
 
-// called at the start of each FS system call.
+// called at the start of each FS system call
+// that may write up to nblocks blocks.
 void
-begin_op(void)
+begin_opn(int nblocks)
 {
   acquire(&log.lock);
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh[log.cur].n + log.reserved + nblocks > log.cap){
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += nblocks;
+      myproc()->logged = 0;
       release(&log.lock);
       break;
     }
   }
 }
 
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
+// The most blocks one call may ask begin_opn() for.
+int
+log_maxop(void)
+{
+  return log.cap / 2;
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// if it logged any blocks, waits until the transaction
+// holding them is on disk; logd commits it once no calls
+// are left in it.
 void
-end_op(void)
+end_opn(int nblocks)
 {
-  int do_commit = 0;
+  int seq;
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= nblocks;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+    wakeup(&log.cur);
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
     // the amount of reserved space.
     wakeup(&log);
   }
+  if(myproc()->logged){
+    seq = log.seq;
+    while(log.durable < seq)
+      sleep(&log.durable, &log.lock);
+  }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
-  }
+void
+end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
 }
 
-// Copy modified blocks from cache to log.
+// Write modified blocks of half h from cache to log, leaving
+// them locked in log.lbuf for install_trans().
 static void
-write_log(void)
+write_log(int h)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
-  }
+  for (tail = 0; tail < log.lh[h].n; tail++)
+    log.lbuf[tail] = bread(log.dev, log.lh[h].block[tail]); // cache block
+  // the log blocks are a run, so this is a few requests.
+  for (tail = 0; tail < log.lh[h].n; tail++)
+    log.home[tail] = logblock(h)+tail+1;
+  bwrite_startat(log.lbuf, log.home, log.lh[h].n);
+  bwaitv(log.lbuf, log.lh[h].n);
 }
 
+// The log thread. Commits the open transaction once no calls
+// are left in it, then lets the next one gather in the other
+// half while it installs this one.
 static void
-commit()
+logd(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  int h;
+
+  acquire(&log.lock);
+  for(;;){
+    h = log.cur;
+    if(log.lh[h].n == 0 || log.outstanding > 0){
+      sleep(&log.cur, &log.lock);
+      continue;
+    }
+    // no calls may touch the blocks until they are in the log.
+    log.committing = 1;
+    log.lh[h].seq = log.seq;
+    release(&log.lock);
+
+    write_log(h);        // Write modified blocks from cache to log
+    write_head(h);       // Write header to disk -- the real commit
+
+    // the other half is empty, since its transaction was
+    // installed before this one was committed.
+    acquire(&log.lock);
+    log.durable = log.seq++;
+    log.cur = !h;
+    log.committing = 0;
+    wakeup(&log.durable);
+    wakeup(&log);
+    release(&log.lock);
+
+    install_trans(h);  // Now install writes to home locations
+    log.lh[h].n = 0;
+    write_head(h);    // Erase the transaction from the log
+
+    acquire(&log.lock);
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// logd's write_log() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -214,23 +336,25 @@ commit()
 void
 log_write(struct buf *b)
 {
+  struct logheader *lh;
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  lh = &log.lh[log.cur];
+  if (lh->n >= log.cap)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
+  myproc()->logged = 1;
 
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorbtion
+  for (i = 0; i < lh->n; i++) {
+    if (lh->block[i] == b->blockno)   // log absorbtion
       break;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n) {  // Add new block to log?
+  lh->block[i] = b->blockno;
+  if (i == lh->n) {  // Add new block to log?
     bpin(b);
-    log.lh.n++;
+    lh->n++;
   }
   release(&log.lock);
 }
-
@@ -7,9 +7,43 @@
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      126  // data blocks in each half of the log mkfs makes
+#define NBUF         (MAXOPBLOCKS*3)  // minimum size of disk block cache
+#define NBUF_MAX     4096  // maximum size of disk block cache
+#define DISK_NSEG    8     // max blocks or pages in one disk request
+#define BCACHE_SHARE 32    // disk block cache gets 1/BCACHE_SHARE of free memory
+#define FSSIZE       32000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
-#define MAX_TOTAL_PAGES 32
-#define MAX_PSYC_PAGES 16
+#define KORDERS      10    // kalloc_pages() orders, 0..KORDERS-1
+#ifndef KALLOC_POISON
+#define KALLOC_POISON 0    // 1: fill allocated and freed pages with junk
+#endif
+#define NSWAP        4096  // pages in the swap area
+#ifndef SWAP_RAW
+#define SWAP_RAW     1     // 0: swap through the buffer cache
+#endif
+#define MAX_PSYC_PAGES 16  // default resident-set limit, see setrss()
+#define PAGEOUT_LOW  8  // wake pageout below 1/PAGEOUT_LOW of the limit free
+#ifndef SWAP_READAHEAD
+#define SWAP_READAHEAD 8  // max pages read ahead on a sequential swap-in
+#endif
+#define PAGEOUT_HIGH 4  // pageout frees up to 1/PAGEOUT_HIGH of the limit
+#ifndef AGE_INTERVAL
+#define AGE_INTERVAL 1  // ticks in user mode between access-bit samples
+#endif
+#ifndef GLOBAL_REPLACE
+#define GLOBAL_REPLACE 0  // 1: replace pages system-wide, not per process
+#endif
+#define MIN_WSET     4    // global: resident pages a process always keeps
+#define FREE_LOW     256  // global: wake pageout below this many free frames
+#define FREE_HIGH    512  // global: pageout frees frames up to this many
+#define FREE_RESERVE 64   // global: faults evict locally below this many
+#ifndef PFF_CONTROL
+#define PFF_CONTROL 0     // 1: size resident sets by page-fault frequency
+#endif
+#define PFF_INTERVAL 10   // PFF: ticks between resident-set adjustments
+#define PFF_LOW      2    // PFF: fewer faults in an interval shrink the limit
+#define PFF_HIGH     8    // PFF: more faults in an interval grow it
+#define PFF_WINDOW   8    // PFF: access samples that make up the working set
+#define PFF_BUDGET   1024 // PFF: resident pages shared by all processes
+#define PFF_ROTATE   8    // PFF: intervals a process stays suspended at most
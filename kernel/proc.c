@@ -3,7 +3,9 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "vmstat.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
@@ -15,15 +17,29 @@ struct proc *initproc;
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// per-process swap bitmaps, NSWAP bits each.
+struct kmem_cache *swapmapcache;
+#define SWAPMAPSIZE (NSWAP/8)
+
 extern void forkret(void);
+static void kthreadret(void);
 static void freeproc(struct proc *p);
+static void wakeup_pageout(void);
+static int pageout_low(struct proc*);
+static void swap_readahead(struct proc *p, uint64 va);
+static void map_loaded_page(struct proc *p, uint64 va, pte_t *pte, uint64 pa, int slot);
 
-struct storedpage* get_free_storedpage(void);
-struct storedpage* get_wanted_storedpage(uint64);
 void update_access_counters(struct proc *p);
 int count_ones(uint);
-uint64 find_nfu(void);
-uint64 find_lapa(void);
+struct page_access_info* find_nfu(struct proc *p);
+struct page_access_info* find_scfifo(struct proc *p);
+struct page_access_info* find_lapa(struct proc *p);
+struct page_access_info* find_clockpro(struct proc *p);
+
+// the pageout daemon sleeps on pageout_wanted
+// until some process runs short of free RAM slots.
+struct spinlock pageout_lock;
+int pageout_wanted;
 
 extern char trampoline[]; // trampoline.S
 
@@ -57,8 +73,10 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  swapmapcache = kmem_cache_create("swapmap", SWAPMAPSIZE);
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
+      initsleeplock(&p->swap_lock, "swap");
       p->kstack = KSTACK((int) (p - proc));
   }
 }
@@ -127,12 +145,6 @@ found:
   p->pid = allocpid();
   p->state = USED;
 
-  if(p->pid > 2){
-    release(&p->lock);
-    createSwapFile(p);
-    acquire(&p->lock);
-  }
-
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
     freeproc(p);
@@ -148,22 +160,26 @@ found:
     return 0;
   }
 
-  struct storedpage* sp;
-  int i = 0;
-  for(sp = p->storedpages; sp < &p->storedpages[MAX_TOTAL_PAGES]; sp++){
-    sp->in_use = 0;
-    sp->page_address = 0;
-    sp->file_offset = PGSIZE*i;
-    i++;
-  }
-  struct page_access_info* pi;
-  p->page_turn = 0;
-  for(pi=p->ram_pages; pi<&p->ram_pages[MAX_PSYC_PAGES]; pi++){
-    pi->loaded_at = 0;
-    pi->access_counter = 0;
-    if (SELECTION == LAPA)
-      pi->access_counter = 4294967295;  
-  }
+  reset_pages(p);
+  p->rss_limit = MAX_PSYC_PAGES;
+  p->wset_min = MIN_WSET;
+  p->policy = SELECTION;
+  p->nfaults = 0;
+  p->fault_time = 0;
+  p->sync_evictions = 0;
+  p->async_evictions = 0;
+  p->clean_evictions = 0;
+  p->readahead = 0;
+  p->swap_ins = 0;
+  p->swap_outs = 0;
+  p->load_time = 0;
+  p->store_time = 0;
+  p->ra_next = 0;
+  p->ra_window = 0;
+  p->pff_faults = 0;
+  p->pff_want = 0;
+  p->age_ticks = 0;
+  p->lowprio = 0;
 
   // Set up new context to start executing at forkret,
   // which returns to user space.
@@ -195,7 +211,11 @@ freeproc(struct proc *p)
   p->killed = 0;
   p->xstate = 0;
   p->state = UNUSED;
-  p->page_turn = 0;
+  reset_pages(p);
+  p->pageout = 0;
+  p->user_preempted = 0;
+  p->suspended = 0;
+  p->kfunc = 0;
 }
 
 // Create a user page table for a given process,
@@ -279,6 +299,35 @@ userinit(void)
   release(&p->lock);
 }
 
+// Start a kernel thread running fn(), which must not return.
+// It has no user memory and never returns to user space.
+// Its pid is 0, which kill() and getvmstat() refuse.
+// If lowprio, it runs only on CPUs that are otherwise idle.
+void
+kthread_create(void (*fn)(void), char *name, int lowprio)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++) {
+    acquire(&p->lock);
+    if(p->state == UNUSED)
+      goto found;
+    release(&p->lock);
+  }
+  panic("kthread_create");
+
+found:
+  p->pid = 0;
+  p->kfunc = fn;
+  p->lowprio = lowprio;
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.ra = (uint64)kthreadret;
+  p->context.sp = p->kstack + PGSIZE;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -287,15 +336,18 @@ growproc(int n)
   uint sz;
   struct proc *p = myproc();
 
+  acquiresleep(&p->swap_lock);
   sz = p->sz;
   if(n > 0){
     if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+      releasesleep(&p->swap_lock);
       return -1;
     }
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
   p->sz = sz;
+  releasesleep(&p->swap_lock);
   return 0;
 }
 
@@ -320,6 +372,22 @@ fork(void)
   }
   np->sz = p->sz;
 
+  // share the swap slots and copy the resident page table.
+  release(&np->lock);
+  acquiresleep(&p->swap_lock);
+  i = copy_pages(p, np);
+  releasesleep(&p->swap_lock);
+  if(i < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  acquire(&np->lock);
+  np->rss_limit = p->rss_limit;
+  np->wset_min = p->wset_min;
+  np->policy = p->policy;
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -334,41 +402,10 @@ fork(void)
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
-  struct storedpage* sp;
-  struct storedpage* nsp = np->storedpages;
+  pid = np->pid;
 
   release(&np->lock);
-  char* buffer = kalloc();
-  if(p->pid>2){
-    for(sp = p->storedpages; sp < &p->storedpages[MAX_TOTAL_PAGES]; sp++){
-      if(sp->in_use){
-        readFromSwapFile(p,buffer,sp->page_address,PGSIZE);
-        writeToSwapFile(np,buffer,sp->page_address,PGSIZE);
-
-        nsp->page_address = sp->page_address;
-        nsp->in_use = sp->in_use;
-      }
-      nsp++;
-    }
-  }
-  acquire(&np->lock);
-  kfree(buffer);
-  struct page_access_info* pi;
-  struct page_access_info* npi = np->ram_pages;
-
-  for(pi = p->ram_pages; pi < &p->ram_pages[MAX_PSYC_PAGES]; pi++){
-    if(pi->in_use){
-      npi->page_address = pi->page_address;
-      npi->in_use = pi->in_use;
-      // npi->loaded_at = pi->loaded_at;
-      npi->access_counter = pi->access_counter;
-    }
-    npi++;
-  }
-  // np->page_turn = p->page_turn;
 
-  pid = np->pid;
-  release(&np->lock);
   acquire(&wait_lock);
 
   np->parent = p;
@@ -415,9 +452,6 @@ exit(int status)
       p->ofile[fd] = 0;
     }
   }
-  if(p->pid>2){
-    removeSwapFile(p);
-  }
 
   begin_op();
   iput(p->cwd);
@@ -453,6 +487,10 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the status is copied out with locks held.
+  if(addr != 0)
+    uvmfaultin(p->pagetable, addr, sizeof(int));
+
   acquire(&wait_lock);
 
   for(;;){
@@ -501,20 +539,25 @@ wait(uint64 addr)
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
+// Low-priority kernel threads run only in a pass that
+// follows one that found nothing else to run.
 void
 scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int idle = 0, found;
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
+    found = 0;
     for(p = proc; p < &proc[NPROC]; p++) {
       acquire(&p->lock);
-      if(p->state == RUNNABLE) {
+      if(p->state == RUNNABLE && !p->pageout && !p->suspended &&
+         (idle || !p->lowprio)) {
         // Switch to chosen process.  It is the process's job
         // to release its lock and then reacquire it
         // before jumping back to us.
@@ -522,13 +565,14 @@ scheduler(void)
         c->proc = p;
         swtch(&c->context, &p->context);
 
-        update_access_counters(p);
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
+        found |= !p->lowprio;
       }
       release(&p->lock);
     }
+    idle = !found;
   }
 }
 // Switch to scheduler.  Must hold only p->lock
@@ -571,6 +615,94 @@ yield(void)
 
 }
 
+// Called after a fault at va has been served. If p has been
+// faulting on consecutive pages, bring in up to ra_window of
+// the swapped-out pages that follow, doubling the window each
+// time, as long as free RAM slots allow. A fault anywhere else
+// looks like random access and turns readahead off.
+// The pages are read from swap together, in one batch.
+static void
+swap_readahead(struct proc *p, uint64 va)
+{
+  uint64 a, end, start;
+  uint64 vas[SWAP_READAHEAD];
+  pte_t *ptes[SWAP_READAHEAD];
+  char *pas[SWAP_READAHEAD];
+  int slots[SWAP_READAHEAD];
+  int i, n;
+  pte_t *pte;
+
+  va = PGROUNDDOWN(va);
+  if(va == p->ra_next){
+    p->ra_window = p->ra_window ? 2*p->ra_window : 1;
+    if(p->ra_window > SWAP_READAHEAD)
+      p->ra_window = SWAP_READAHEAD;
+  } else {
+    p->ra_window = 0;
+  }
+
+  end = va + (1 + p->ra_window)*PGSIZE;
+  n = 0;
+  for(a = va + PGSIZE; a < end && a < p->sz; a += PGSIZE){
+    // leave a slot for the next fault.
+    if(free_ram_slots(p) - n <= 1)
+      break;
+    if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_PG) == 0)
+      continue;
+    if((pas[n] = kalloc_nofill()) == 0)
+      break;
+    vas[n] = a;
+    ptes[n] = pte;
+    slots[n] = PTE2SLOT(*pte);
+    n++;
+  }
+  p->ra_next = a;
+  if(n == 0)
+    return;
+
+  start = r_time();
+  swapread_batch(pas, slots, n);
+  for(i = 0; i < n; i++){
+    if(reserve_ram_page(p) < 0){
+      // the pages stay swapped out.
+      for(; i < n; i++)
+        kfree(pas[i]);
+      break;
+    }
+    map_loaded_page(p, vas[i], ptes[i], (uint64)pas[i], slots[i]);
+    p->readahead++;
+  }
+  p->load_time += r_time() - start;
+}
+
+// Give up the CPU at a timer interrupt taken in user mode.
+// p holds no kernel state until it is resumed, so the pageout
+// daemon may evict its pages in the meantime.
+// Every AGE_INTERVAL such ticks, first sample p's access bits.
+void
+preempt(void)
+{
+  struct proc *p = myproc();
+
+  if(swapping(p) && ++p->age_ticks >= AGE_INTERVAL){
+    p->age_ticks = 0;
+    acquiresleep(&p->swap_lock);
+    update_access_counters(p);
+    releasesleep(&p->swap_lock);
+  }
+
+  if(swapping(p) && (GLOBAL_REPLACE ? kfreepages() < FREE_LOW :
+                                      free_ram_slots(p) < pageout_low(p)))
+    wakeup_pageout();
+
+  acquire(&p->lock);
+  p->user_preempted = 1;
+  p->state = RUNNABLE;
+  sched();
+  p->user_preempted = 0;
+  release(&p->lock);
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -583,7 +715,7 @@ forkret(void)
 
   if (first) {
     // File system initialization must be run in the context of a
-    // regular processreadFromSwapFile (e.g., because it calls sleep), and thus cannot
+    // regular process (e.g., because it calls sleep), and thus cannot
     // be run from main().
     first = 0;
     fsinit(ROOTDEV);
@@ -592,6 +724,20 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfunc();
+  panic("kthread returned");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -599,7 +745,7 @@ sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
   
-  // Must acquire p->lreadFromSwapFileock in order to
+  // Must acquire p->lock in order to
   // change p->state and then call sched.
   // Once we hold p->lock, we can be
   // guaranteed that we won't miss any wakeup
@@ -650,10 +796,14 @@ kill(int pid)
 {
   struct proc *p;
 
+  // unused slots and kernel threads have pid 0.
+  if(pid <= 0)
+    return -1;
   for(p = proc; p < &proc[NPROC]; p++){
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
+      p->suspended = 0;
       if(p->state == SLEEPING){
         // Wake process from sleep().
         p->state = RUNNABLE;
@@ -696,6 +846,83 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
+// Counters are read without p->swap_lock, so a
+// sample taken while p pages may be slightly off.
+// Caller must hold p->lock.
+static void
+fillvmstat(struct proc *p, struct vmstat *st)
+{
+  st->pid = p->pid;
+  safestrcpy(st->name, p->name, sizeof(st->name));
+  st->resident = p->nram;
+  st->swapped = p->nswapped;
+  st->rss_limit = p->rss_limit;
+  safestrcpy(st->policy, policyname(p), sizeof(st->policy));
+  st->faults = p->nfaults;
+  st->fault_time = p->fault_time;
+  st->sync_evictions = p->sync_evictions;
+  st->async_evictions = p->async_evictions;
+  st->clean_evictions = p->clean_evictions;
+  st->readahead = p->readahead;
+  st->swap_ins = p->swap_ins;
+  st->swap_outs = p->swap_outs;
+  st->load_time = p->load_time;
+  st->store_time = p->store_time;
+  swapstat(st);
+  kallocstat(st);
+  slabstat(st);
+  bcachestat(st);
+}
+
+// Copy the paging counters of process pid
+// to user address addr.
+// Returns 0 on success, -1 on error.
+int
+getvmstat(int pid, uint64 addr)
+{
+  struct proc *p;
+  struct vmstat st;
+
+  // unused slots and kernel threads have pid 0.
+  if(pid <= 0)
+    return -1;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      fillvmstat(p, &st);
+      release(&p->lock);
+      return copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st));
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+// Copy out the paging counters of up to n processes, in
+// proc[] order, to the array of struct vmstat at addr.
+// Returns how many, or -1.
+int
+getvmstats(uint64 addr, int n)
+{
+  struct proc *p;
+  struct vmstat st;
+  int i = 0;
+
+  for(p = proc; p < &proc[NPROC] && i < n; p++){
+    acquire(&p->lock);
+    if(p->state == UNUSED){
+      release(&p->lock);
+      continue;
+    }
+    fillvmstat(p, &st);
+    release(&p->lock);
+    if(copyout(myproc()->pagetable, addr + i*sizeof(st), (char *)&st, sizeof(st)) < 0)
+      return -1;
+    i++;
+  }
+  return i;
+}
+
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
@@ -721,130 +948,828 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    if(p->nram || p->nswapped)
+      printf(" rss %d swapped %d", p->nram, p->nswapped);
+    if(p->nfaults)
+      printf(" faults %d evict %d/%d clean %d avg %d cycles", (int)p->nfaults,
+             (int)p->sync_evictions, (int)p->async_evictions,
+             (int)p->clean_evictions, (int)(p->fault_time / p->nfaults));
     printf("\n");
   }
 }
 
+static void
+bitmap_free(uint64 *map, int i)
+{
+  map[i/64] &= ~(1UL << (i%64));
+}
+
+// Entry i of p's ram_pages.
+static struct page_access_info*
+ram_page(struct proc *p, int i){
+  return &p->ram_pages[i / RAM_PER_PAGE][i % RAM_PER_PAGE];
+}
+
+// Index of entry pi in p's ram_pages.
+static int
+ram_index(struct proc *p, struct page_access_info *pi){
+  int c;
+
+  for(c = 0; c < NRAMPAGES; c++){
+    if(pi >= p->ram_pages[c] && pi < p->ram_pages[c] + RAM_PER_PAGE)
+      return c*RAM_PER_PAGE + (pi - p->ram_pages[c]);
+  }
+  panic("ram_index");
+}
+
+// Make sure ram_pages has room for one more resident page.
 int
-store_page(pte_t *pte, uint64 page_address){
-  struct page_access_info* pi;
-  struct proc *p = myproc();
-  struct storedpage *sp = get_free_storedpage();
+reserve_ram_page(struct proc *p){
+  int i = p->nram / RAM_PER_PAGE;
 
-  uint64 pa = PTE2PA(*pte);
-  // if(p->pid == 4)
-  //   printf("storing va:%p from pa:%p, off:%p\n",PGROUNDDOWN(page_address sp->file_offset);
-  if(!sp || !pa)
+  if(p->nram >= MAX_RSS_PAGES)
     return -1;
-  // if(writeToSwapFile(p, (char*)pa, sp->file_offset, PGSIZE)<0){
-  //   printf("storing va:%p from pa:%p FAILED off:%p\n",PGROUNDDOWN(page_address),pa,sp->file_offset);
-  // }
-  writeToSwapFile(p, (char*)pa, sp->file_offset, PGSIZE);
+  if(p->ram_pages[i] == 0 &&
+     (p->ram_pages[i] = (struct page_access_info*)kalloc_nofill()) == 0)
+    return -1;
+  return 0;
+}
+
+// Allocate a swap slot for p.
+int
+alloc_slot(struct proc *p){
+  struct page_access_info *pi;
+  int i, slot;
+
+  if(p->swap_bitmap == 0){
+    if((p->swap_bitmap = (uint64*)kmem_cache_alloc(swapmapcache)) == 0)
+      return -1;
+    memset(p->swap_bitmap, 0, SWAPMAPSIZE);
+  }
+  if((slot = swapalloc()) >= 0){
+    p->swap_bitmap[slot/64] |= 1UL << (slot%64);
+    return slot;
+  }
+  // all taken: give up the copy kept for a resident page,
+  // which will need a write when it is evicted again.
+  for(i = 0; i < p->nram; i++){
+    pi = ram_page(p, i);
+    if(pi->slot >= 0 && swaprefs(pi->slot) == 1){
+      slot = pi->slot;
+      pi->slot = -1;
+      return slot;
+    }
+  }
+  return -1;
+}
+
+void
+free_slot(struct proc *p, int slot){
+  bitmap_free(p->swap_bitmap, slot);
+  swapfree(slot);
+}
+
+// CLOCKPRO: remember that the page at va was evicted.
+static void
+ghost_add(struct proc *p, uint64 va){
+  p->ghost[p->ghost_next] = va | 1;
+  p->ghost_next = (p->ghost_next + 1) % NGHOST;
+}
+
+// CLOCKPRO: was the page at va evicted lately? Forgets it.
+static int
+ghost_hit(struct proc *p, uint64 va){
+  int i;
 
-  sp->in_use = 1;
-  sp->page_address = page_address;
-  *pte |= PTE_PG;
-  *pte &= ~PTE_V;
+  for(i = 0; i < NGHOST; i++){
+    if(p->ghost[i] == (va | 1)){
+      p->ghost[i] = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
 
-  for(pi=p->ram_pages; pi<&p->ram_pages[MAX_PSYC_PAGES]; pi++){
-    if(pi->page_address == page_address)
-      pi->in_use = 0;
+// Write the resident page pi to a swap slot, free its
+// frame, and leave the slot number in the PTE.
+int
+store_page(struct proc *p, struct page_access_info *pi){
+  uint64 start = r_time();
+  pte_t *pte = pi->pte;
+  uint64 pa = PTE2PA(*pte);
+  // a page loaded from the swap area keeps its slot there,
+  // which stays good until the page is written to.
+  int slot = pi->slot;
+  int clean = slot >= 0 && !(*pte & PTE_D);
+
+  // a slot shared with a forked process is not ours to write.
+  if(slot >= 0 && !clean && swaprefs(slot) > 1){
+    free_slot(p, slot);
+    slot = pi->slot = -1;
+  }
+  if(!pa || (slot < 0 && (slot = alloc_slot(p)) < 0))
+    return -1;
+  if(clean){
+    p->clean_evictions++;
+  } else {
+    swapwrite((char*)pa, slot);
+    p->swap_outs++;
   }
 
+  *pte = SLOT2PTE(slot) | (PTE_FLAGS(*pte) & ~(PTE_V | PTE_D)) | PTE_PG;
+  pi->slot = -1;
+  if(p->policy == CLOCKPRO)
+    ghost_add(p, pi->page_address);
+  remove_ram_page(p, pi);
+  p->nswapped++;
+
   kfree((void*)pa);
+  p->store_time += r_time() - start;
 
   return 0;
 }
 
 // load page which va belongs to from disk to pa
 int
-load_page(uint64 va){
-  struct proc *p = myproc();
-  struct storedpage *sp = get_wanted_storedpage(va);
+load_page(struct proc *p, uint64 va){
+  uint64 start = r_time();
   pte_t *pte;
+  uint64 pa;
+  int slot;
+
   va = PGROUNDDOWN(va);
-  if((pte = walk(p->pagetable,va,0)) == 0)
+  if((pte = walk(p->pagetable,va,0)) == 0 || (*pte & PTE_PG) == 0)
     return -1;
+  slot = PTE2SLOT(*pte);
 
-  uint64 pa;
-  if((pa = (uint64) kalloc()) == 0){
+  if(reserve_ram_page(p) < 0 || (pa = (uint64) kalloc_nofill()) == 0){
     return -1;
   }
 
-  // if(p->pid == 4)
-  //   printf("loading va:%p to pa:%p off:%p\n",PGROUNDDOWN(va),pa,sp->file_offset);
+  swapread((char*)pa, slot);
+  map_loaded_page(p, va, pte, pa, slot);
+  p->load_time += r_time() - start;
+
+  return 0;
+}
+
+// Map the frame pa, just read from slot, at va in place of
+// the swapped-out page that pte refers to.
+// Caller must have made room with reserve_ram_page().
+static void
+map_loaded_page(struct proc *p, uint64 va, pte_t *pte, uint64 pa, int slot){
+  // the slot stays in use, see store_page(). the page starts
+  // out clean; the hardware sets PTE_D on the first write.
+  *pte = PA2PTE(pa) | (PTE_FLAGS(*pte) & ~(PTE_PG | PTE_D)) | PTE_V;
+  add_ram_page(p, P_LEVELS_ADDRESS(va), pte, slot);
+  p->nswapped--;
+  p->swap_ins++;
+}
+
+// Link entry i into p's ring as the newest, just
+// behind the clock hand.
+static void
+ring_insert(struct proc *p, int i){
+  struct page_access_info *pi = ram_page(p, i);
+  struct page_access_info *hand;
+
+  if(p->nram == 1){
+    pi->prev = pi->next = i;
+    p->clock_hand = i;
+    return;
+  }
+  hand = ram_page(p, p->clock_hand);
+  pi->next = p->clock_hand;
+  pi->prev = hand->prev;
+  ram_page(p, hand->prev)->next = i;
+  hand->prev = i;
+}
+
+// Unlink entry i from p's ring. If the hand was there,
+// it moves on to the next oldest.
+static void
+ring_remove(struct proc *p, int i){
+  struct page_access_info *pi = ram_page(p, i);
+
+  if(p->clock_hand == i)
+    p->clock_hand = pi->next;
+  ram_page(p, pi->prev)->next = pi->next;
+  ram_page(p, pi->next)->prev = pi->prev;
+}
+
+// Record the user page at va, mapped by pte, as resident in p.
+// slot holds a copy of it in the swap area, or is -1.
+// Caller must have made room with reserve_ram_page(), and
+// evicted if p is at its resident limit.
+void
+add_ram_page(struct proc *p, uint64 va, pte_t *pte, int slot){
+  struct page_access_info* pi;
+
+  if(p->nram >= MAX_RSS_PAGES || p->ram_pages[p->nram / RAM_PER_PAGE] == 0)
+    panic("add_ram_page");
+  pi = ram_page(p, p->nram++);
+  pi->page_address = va;
+  pi->pte = pte;
+  pi->slot = slot;
+  ring_insert(p, p->nram - 1);
+  if(p->policy == LAPA)
+    pi->access_counter = 4294967295;
+  else
+    pi->access_counter = 0;
+  pi->hot = 0;
+  pi->fresh = 1;
+  if(p->policy == CLOCKPRO && ghost_hit(p, va)){
+    // evicted too soon: it comes back hot, and more
+    // room is kept for cold pages.
+    pi->hot = 1;
+    pi->fresh = 0;
+    p->nhot++;
+    if(p->cold_target < p->rss_limit - 1)
+      p->cold_target++;
+  }
+}
+
+// Drop pi from ram_pages, moving the last entry into its place.
+void
+remove_ram_page(struct proc *p, struct page_access_info *pi){
+  struct page_access_info *last;
+  int i, l;
+
+  if(pi->slot >= 0)
+    free_slot(p, pi->slot);
+  if(pi->hot)
+    p->nhot--;
+  i = ram_index(p, pi);
+  ring_remove(p, i);
+  l = --p->nram;
+  last = ram_page(p, l);
+  if(pi == last)
+    return;
+  *pi = *last;
+  if(pi->next == l){
+    // last was alone in the ring.
+    pi->prev = pi->next = i;
+  } else {
+    ram_page(p, pi->prev)->next = i;
+    ram_page(p, pi->next)->prev = i;
+  }
+  if(p->clock_hand == l)
+    p->clock_hand = i;
+}
+
+// Forget p's resident and swapped pages in [start, end),
+// before uvmdealloc() unmaps them.
+void
+remove_pages(struct proc *p, uint64 start, uint64 end){
+  struct page_access_info* pi;
+  pte_t *pte;
+  uint64 a;
+  int i;
+
+  for(a = start; a < end; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) != 0 && (*pte & PTE_PG)){
+      free_slot(p, PTE2SLOT(*pte));
+      p->nswapped--;
+    }
+  }
+  for(i = 0; i < p->nram; ){
+    pi = ram_page(p, i);
+    if(pi->page_address >= start && pi->page_address < end)
+      remove_ram_page(p, pi);
+    else
+      i++;
+  }
+}
+
+// Give np, a child being forked, a share of p's swap slots
+// and a copy of p's resident page records. uvmcopy() has
+// copied the PTEs, which name the same slots.
+// Caller must hold p->swap_lock.
+int
+copy_pages(struct proc *p, struct proc *np){
+  struct page_access_info *pi, *npi;
+  int i;
+
+  if(p->swap_bitmap){
+    if((np->swap_bitmap = (uint64*)kmem_cache_alloc(swapmapcache)) == 0)
+      return -1;
+    memmove(np->swap_bitmap, p->swap_bitmap, SWAPMAPSIZE);
+    for(i = 0; i < NSWAP; i++){
+      if(p->swap_bitmap[i/64] & (1UL << (i%64)))
+        swapdup(i);
+    }
+  }
+
+  for(i = 0; i < p->nram; i++){
+    if(reserve_ram_page(np) < 0)
+      return -1;
+    pi = ram_page(p, i);
+    npi = ram_page(np, np->nram++);
+    *npi = *pi;
+    npi->pte = walk(np->pagetable, pi->page_address, 0);
+  }
+  np->clock_hand = p->clock_hand;
+  np->nhot = p->nhot;
+  np->cold_target = p->cold_target;
+  np->nswapped = p->nswapped;
+  memmove(np->ghost, p->ghost, sizeof(p->ghost));
+  np->ghost_next = p->ghost_next;
+  return 0;
+}
+
+// Forget all of p's pages and free its paging tables,
+// for a new, exec'ed or freed process.
+void
+reset_pages(struct proc *p){
+  int i;
 
-  if(!sp)
+  if(p->swap_bitmap){
+    for(i = 0; i < NSWAP; i++){
+      if(p->swap_bitmap[i/64] & (1UL << (i%64)))
+        swapfree(i);
+    }
+    kmem_cache_free(swapmapcache, p->swap_bitmap);
+  }
+  p->swap_bitmap = 0;
+  for(i = 0; i < NRAMPAGES; i++){
+    if(p->ram_pages[i])
+      kfree((void*)p->ram_pages[i]);
+    p->ram_pages[i] = 0;
+  }
+  p->nram = 0;
+  p->clock_hand = 0;
+  p->nhot = 0;
+  p->cold_target = 1;
+  memset(p->ghost, 0, sizeof(p->ghost));
+  p->ghost_next = 0;
+  p->nswapped = 0;
+}
+
+// Does p keep part of its memory in the swap area?
+int
+swapping(struct proc *p){
+  return SELECTION != NONE && p->pid > 2;
+}
+
+// Number of RAM slots p can still fill without evicting.
+// Negative if setrss() has lowered the limit under nram.
+// Under global replacement p may grow while physical memory
+// lasts, and needs to make room itself only when it runs out.
+int
+free_ram_slots(struct proc *p){
+  int n;
+
+  if(!GLOBAL_REPLACE)
+    return p->rss_limit - p->nram;
+  if(p->nram < p->wset_min)
+    return p->wset_min - p->nram;
+  n = kfreepages() - FREE_RESERVE;
+  return n < MAX_RSS_PAGES - p->nram ? n : MAX_RSS_PAGES - p->nram;
+}
+
+// Pageout watermarks, in free RAM slots.
+static int
+pageout_low(struct proc *p){
+  return p->rss_limit/PAGEOUT_LOW > 0 ? p->rss_limit/PAGEOUT_LOW : 1;
+}
+
+static int
+pageout_high(struct proc *p){
+  return p->rss_limit/PAGEOUT_HIGH > 0 ? p->rss_limit/PAGEOUT_HIGH : 1;
+}
+
+// Set p's resident-set limit to n pages and evict down to it.
+// Returns the old limit, or -1.
+int
+setrss(struct proc *p, int n){
+  int old;
+
+  if(n < 1 || n > MAX_RSS_PAGES)
     return -1;
+  acquiresleep(&p->swap_lock);
+  old = p->rss_limit;
+  p->rss_limit = n;
+  while(swapping(p) && free_ram_slots(p) < 0 && evict_page(p) == 0)
+    p->sync_evictions++;
+  releasesleep(&p->swap_lock);
+  return old;
+}
 
-  readFromSwapFile(p, (char*)pa, sp->file_offset, PGSIZE);
-    // printf("loading va:%p to pa:%p FAILED\n",PGROUNDDOWN(va),pa,sp->file_offset);
-  
-  
-  sp->in_use = 0;
-  sp->page_address = 0;
+// Choose a victim among p's resident pages and
+// write it to the swap area.
+// Caller must hold p->swap_lock.
+int
+evict_page(struct proc *p){
+  struct page_access_info *pi;
 
-  if(mappages(p->pagetable, PGROUNDDOWN(va), PGSIZE, pa, PTE_FLAGS(*pte)) != 0){
-    printf("failed to mappages, gonna free pa\n");
-    kfree((void*)pa);
+  if((pi = find_page_to_store(p)) == 0)
     return -1;
+  return store_page(p, pi);
+}
+
+// Handle a fault on the swapped-out page holding va.
+// Usually the pageout daemon has left a free RAM slot,
+// so the fault costs only the read from the swap area.
+int
+swap_in(struct proc *p, uint64 va){
+  uint64 start = r_time();
+  int r = 0;
+
+  acquiresleep(&p->swap_lock);
+  while(r == 0 && free_ram_slots(p) <= 0){
+    if((r = evict_page(p)) == 0)
+      p->sync_evictions++;
+  }
+  if(r == 0 && (r = load_page(p, va)) == 0)
+    swap_readahead(p, va);
+  p->nfaults++;
+  p->fault_time += r_time() - start;
+  releasesleep(&p->swap_lock);
+
+  return r;
+}
+
+static void
+wakeup_pageout(void)
+{
+  acquire(&pageout_lock);
+  pageout_wanted = 1;
+  wakeup(&pageout_wanted);
+  release(&pageout_lock);
+}
+
+// Take p's swap_lock for the pageout daemon, if p may be
+// paged out. Only processes preempted in user mode are touched,
+// and they are kept off every CPU until pageout_end(), so that
+// no hart runs p with a TLB entry for a page being freed.
+static int
+pageout_begin(struct proc *p)
+{
+  acquire(&p->lock);
+  if(p->state != RUNNABLE || !p->user_preempted || !swapping(p)){
+    release(&p->lock);
+    return 0;
+  }
+  release(&p->lock);
+
+  acquiresleep(&p->swap_lock);
+  acquire(&p->lock);
+  if(p->state != RUNNABLE || !p->user_preempted || !swapping(p)){
+    release(&p->lock);
+    releasesleep(&p->swap_lock);
+    return 0;
   }
+  p->pageout = 1;
+  release(&p->lock);
+  return 1;
+}
+
+static void
+pageout_end(struct proc *p)
+{
+  acquire(&p->lock);
+  p->pageout = 0;
+  release(&p->lock);
+  releasesleep(&p->swap_lock);
+}
 
+// Evict pages of p until it has pageout_high() free RAM slots,
+// or all of them if pffd has suspended p.
+static void
+pageout(struct proc *p)
+{
+  if(!pageout_begin(p))
+    return;
+  if(p->suspended){
+    while(p->nram > 0 && evict_page(p) == 0)
+      p->async_evictions++;
+  } else if(free_ram_slots(p) < pageout_low(p)){
+    while(free_ram_slots(p) < pageout_high(p) && evict_page(p) == 0)
+      p->async_evictions++;
+  }
+  pageout_end(p);
+}
+
+// Global replacement: a clock hand sweeps the resident pages
+// of all processes, in proc[] order, as one list. A page that
+// has been accessed since the hand last passed gets a second
+// chance; any other is evicted, unless its process is down to
+// its minimum working set. Runs until FREE_HIGH frames are free
+// or the hand has gone twice around.
+static struct proc *hand_proc = proc;
+static int hand_i;
+
+static void
+global_pageout(void)
+{
+  struct proc *p;
   struct page_access_info *pi;
-  for(pi=p->ram_pages; pi<&p->ram_pages[MAX_PSYC_PAGES]; pi++){
-    if(!pi->in_use){
-      pi->in_use = 1;
-      pi->page_address = P_LEVELS_ADDRESS(va);
-      pi->loaded_at = get_next_turn(p);
-      if(SELECTION == LAPA)
-        pi->access_counter = 4294967295;
-      else
-        pi->access_counter = 0;
-      break;
+  int n, more;
+
+  for(n = 0; n < 2*NPROC && kfreepages() < FREE_HIGH; n++){
+    p = hand_proc;
+    if(pageout_begin(p)){
+      while((more = hand_i < p->nram) && kfreepages() < FREE_HIGH){
+        pi = ram_page(p, hand_i);
+        // update_access_counters() moves PTE_A into the counter.
+        if((*pi->pte & PTE_A) || (pi->access_counter & (1U << 31))){
+          *pi->pte &= ~PTE_A;
+          pi->access_counter &= ~(1U << 31);
+          hand_i++;
+        } else if(p->nram > p->wset_min && store_page(p, pi) == 0){
+          // the last entry has moved into hand_i.
+          p->async_evictions++;
+        } else {
+          hand_i++;
+        }
+      }
+      pageout_end(p);
+      if(more)
+        return;
     }
+    hand_i = 0;
+    hand_proc = p + 1 < &proc[NPROC] ? p + 1 : proc;
   }
+}
 
-  *pte &= ~PTE_PG;
+// The pageout daemon. Keeps a pool of free RAM slots in every
+// swapping process, or of free frames under GLOBAL_REPLACE, so
+// that page faults need not write a victim to the swap area
+// before reading the wanted page.
+static void
+pageoutd(void)
+{
+  struct proc *p;
 
-  return 0;
+  acquire(&pageout_lock);
+  for(;;){
+    while(pageout_wanted == 0)
+      sleep(&pageout_wanted, &pageout_lock);
+    pageout_wanted = 0;
+    release(&pageout_lock);
+
+    if(GLOBAL_REPLACE)
+      global_pageout();
+    else
+      for(p = proc; p < &proc[NPROC]; p++)
+        pageout(p);
+
+    acquire(&pageout_lock);
+  }
 }
 
-struct storedpage*
-get_free_storedpage(void){
-  struct proc *p = myproc();
-  struct storedpage* sp;
-  for(sp = p->storedpages; sp < &p->storedpages[MAX_TOTAL_PAGES]; sp++){
-    if(!sp->in_use){
-      return sp;
+// Page-fault-frequency resident set sizing, with PFF_CONTROL.
+// Every PFF_INTERVAL ticks pffd counts each process's faults in
+// the interval. A process faulting less than PFF_LOW times has
+// its limit cut to its working set, which frees frames for the
+// others. One faulting more than PFF_HIGH times gets more, out
+// of the PFF_BUDGET frames all processes share, but never so
+// many that the others could not keep MIN_WSET each. When the
+// budget cannot cover the demand, the biggest other process is
+// suspended and paged out whole, to stop the lot thrashing. It
+// is resumed when its frames fit in the budget again, and the
+// one suspended longest is resumed after PFF_ROTATE intervals
+// regardless.
+
+// Does pffd size p's resident set?
+// Caller must hold p->lock.
+static int
+pff_managed(struct proc *p)
+{
+  return (p->state == SLEEPING || p->state == RUNNABLE || p->state == RUNNING) &&
+         swapping(p) && !p->suspended;
+}
+
+// Take p's swap_lock and p->lock for pffd, if p is still process
+// pid and pffd sizes its resident set. Holding p->lock keeps the
+// slot from being freed and reused by allocproc() meanwhile.
+static int
+pff_begin(struct proc *p, int pid)
+{
+  acquire(&p->lock);
+  if(p->pid != pid || !pff_managed(p)){
+    release(&p->lock);
+    return 0;
+  }
+  release(&p->lock);
+
+  acquiresleep(&p->swap_lock);
+  acquire(&p->lock);
+  if(p->pid != pid || !pff_managed(p)){
+    release(&p->lock);
+    releasesleep(&p->swap_lock);
+    return 0;
+  }
+  return 1;
+}
+
+static void
+pff_end(struct proc *p)
+{
+  release(&p->lock);
+  releasesleep(&p->swap_lock);
+}
+
+// Number of p's resident pages accessed in the
+// last PFF_WINDOW access samples.
+static int
+working_set(struct proc *p)
+{
+  uint mask = ~0U << (32 - PFF_WINDOW);
+  int i, n = 0;
+
+  for(i = 0; i < p->nram; i++){
+    if(ram_page(p, i)->access_counter & mask)
+      n++;
+  }
+  return n;
+}
+
+// Suspend the process with the largest resident limit
+// other than hot, if one can be paged out right now.
+static void
+pff_suspend(struct proc *hot, int interval)
+{
+  struct proc *p, *big = 0;
+  int pid = 0, limit = 0;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    if(p == hot)
+      continue;
+    acquire(&p->lock);
+    if(pff_managed(p) && p->user_preempted &&
+       (big == 0 || p->rss_limit > limit)){
+      big = p;
+      pid = p->pid;
+      limit = p->rss_limit;
     }
+    release(&p->lock);
   }
-  return 0;
+  if(big == 0)
+    return;
+  acquire(&big->lock);
+  if(big->pid == pid && big->state == RUNNABLE && big->user_preempted &&
+     !big->killed){
+    big->suspended = 1;
+    big->suspended_at = interval;
+  }
+  release(&big->lock);
+  wakeup_pageout();
 }
 
-struct storedpage*
-get_wanted_storedpage(uint64 va){
-  struct proc *p = myproc();
-  struct storedpage* sp;
-  uint64 page_address = P_LEVELS_ADDRESS(va);
+static void
+pff_adjust(void)
+{
+  static int interval;
+  struct proc *p, *hot = 0, *old;
+  int pids[NPROC];
+  uint64 faults;
+  int committed = 0, nproc = 0, cap, ws, n, pid = 0, since = 0;
+
+  interval++;
 
-  for(sp = p->storedpages; sp < &p->storedpages[MAX_TOTAL_PAGES]; sp++){
-    if(sp->page_address == page_address && sp->in_use){
-      return sp;
+  // no process may grow past the budget less MIN_WSET for
+  // each of the others, suspended ones included, so that one
+  // hot process cannot take it all.
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    pids[p - proc] = p->pid;
+    if(pff_managed(p) || p->suspended)
+      nproc++;
+    release(&p->lock);
+  }
+  cap = PFF_BUDGET - (nproc - 1) * MIN_WSET;
+  if(cap > MAX_RSS_PAGES)
+    cap = MAX_RSS_PAGES;
+
+  // cut the cold, and note what the hot want.
+  for(p = proc; p < &proc[NPROC]; p++){
+    if(!pff_begin(p, pids[p - proc])){
+      pids[p - proc] = 0;
+      continue;
     }
+    faults = p->nfaults - p->pff_faults;
+    p->pff_faults = p->nfaults;
+    p->pff_want = 0;
+    if(faults < PFF_LOW){
+      ws = working_set(p);
+      if(ws < MIN_WSET)
+        ws = MIN_WSET;
+      if(ws < p->rss_limit)
+        p->rss_limit = ws;
+    } else if(faults > PFF_HIGH && p->rss_limit < cap){
+      p->pff_want = faults < cap - p->rss_limit ?
+                    faults : cap - p->rss_limit;
+    }
+    committed += p->rss_limit;
+    pff_end(p);
   }
-  return 0;
+
+  // grow the hot out of what the budget has left.
+  for(p = proc; p < &proc[NPROC]; p++){
+    if(pids[p - proc] == 0 || p->pff_want == 0 || !pff_begin(p, pids[p - proc]))
+      continue;
+    n = PFF_BUDGET - committed;
+    if(n > p->pff_want)
+      n = p->pff_want;
+    if(n > 0){
+      p->rss_limit += n;
+      committed += n;
+    }
+    if(n < p->pff_want)
+      hot = p;
+    p->pff_want = 0;
+    pff_end(p);
+  }
+
+  if(hot)
+    pff_suspend(hot, interval);
+
+  // resume the process suspended longest once its frames fit,
+  // even while another is hot, so that suspension rotates. once
+  // it has waited PFF_ROTATE intervals, resume it with what the
+  // budget has left; then it is the one that turns hot.
+  old = 0;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->suspended && (old == 0 || p->suspended_at < since)){
+      old = p;
+      pid = p->pid;
+      since = p->suspended_at;
+    }
+    release(&p->lock);
+  }
+  if(old){
+    acquiresleep(&old->swap_lock);
+    acquire(&old->lock);
+    n = PFF_BUDGET - committed;
+    if(old->pid == pid && old->suspended &&
+       (old->rss_limit <= n || interval - since >= PFF_ROTATE)){
+      if(n < MIN_WSET)
+        n = MIN_WSET;
+      if(n < old->rss_limit)
+        old->rss_limit = n;
+      old->suspended = 0;
+      committed += old->rss_limit;
+    }
+    release(&old->lock);
+    releasesleep(&old->swap_lock);
+  }
+
+  // with none hot, resume all that fit.
+  if(!hot){
+    for(p = proc; p < &proc[NPROC]; p++){
+      acquire(&p->lock);
+      if(p->suspended && committed + p->rss_limit <= PFF_BUDGET){
+        p->suspended = 0;
+        committed += p->rss_limit;
+      }
+      release(&p->lock);
+    }
+  }
+  wakeup_pageout();
+}
+
+static void
+pffd(void)
+{
+  uint t0;
+
+  for(;;){
+    acquire(&tickslock);
+    t0 = ticks;
+    while(ticks - t0 < PFF_INTERVAL)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+    pff_adjust();
+  }
+}
+
+void
+pageoutinit(void)
+{
+  initlock(&pageout_lock, "pageout");
+  if(SELECTION != NONE)
+    kthread_create(pageoutd, "pageout", 0);
+  if(SELECTION != NONE && PFF_CONTROL && !GLOBAL_REPLACE)
+    kthread_create(pffd, "pffd", 0);
 }
 
+// Shift PTE_A of each of p's resident pages into its
+// access counter, for NFUA, LAPA and PFF.
+// Caller must hold p->swap_lock.
 void
 update_access_counters(struct proc *p){
   struct page_access_info *pi;
-  for(pi=p->ram_pages; pi<&p->ram_pages[MAX_PSYC_PAGES]; pi++){
+  int i;
+
+  for(i = 0; i < p->nram; i++){
+    pi = ram_page(p, i);
     pi->access_counter = pi->access_counter >> 1;
-    pte_t *pte = walk(p->pagetable,pi->page_address,0); 
-    //if page is valid and was accessed
-    if(*pte & PTE_V && *pte & PTE_A){
+    // resident pages keep their PTE, cached in pi->pte.
+    if(*pi->pte & PTE_A){
       pi->access_counter |= 1 << 31;
-      *pte &= ~PTE_A;
+      *pi->pte &= ~PTE_A;
     }
   }
 }
@@ -862,71 +1787,57 @@ count_ones(uint accesses){
   return counter;
 }
 
-uint64 get_next_turn(struct proc* p){
-  uint64 next_turn = p->page_turn;
-  p->page_turn++;
-  return next_turn;
-} 
-
-uint64
-find_nfu(void){
-  struct proc *p = myproc();
+struct page_access_info*
+find_nfu(struct proc *p){
   uint64 _min = 18446744073709551615UL; 
 
   struct page_access_info *pi;
   struct page_access_info *min_pi = 0;
+  int i;
 
-  for(pi=p->ram_pages; pi<&p->ram_pages[MAX_PSYC_PAGES]; pi++){
-    if(pi->in_use && pi->access_counter < _min && (*walk(p->pagetable,pi->page_address,0) & PTE_V) && pi->page_address != TRAMPOLINE && pi->page_address != TRAPFRAME){
+  for(i = 0; i < p->nram; i++){
+    pi = ram_page(p, i);
+    if(pi->access_counter < _min && (*pi->pte & PTE_V) && pi->page_address != TRAMPOLINE && pi->page_address != TRAPFRAME){
       _min = pi->access_counter;
       min_pi = pi;
     }
   }
 
-  return min_pi->page_address;
+  return min_pi;
 }
 
-uint64 
-find_scfifo(void){
-  struct proc *p = myproc();
+// Second-chance FIFO as a clock: the hand sweeps the ring from
+// the oldest page, clearing PTE_A and moving past each page that
+// has it, which makes that page the newest, and stops at the
+// first that does not. Evicting the page moves the hand on.
+struct page_access_info*
+find_scfifo(struct proc *p){
   struct page_access_info *pi;
-  uint64 _min;
-  struct page_access_info *min_pi;
-  pte_t* pte;
-  int looper = 0;
-  while(1){
-    looper++;
-    _min = 18446744073709551615UL;
-    min_pi = 0;
-
-    for(pi=p->ram_pages; pi<&p->ram_pages[MAX_PSYC_PAGES]; pi++){
-      if(pi->in_use && pi->loaded_at < _min && (*walk(p->pagetable,pi->page_address,0) & PTE_V) && pi->page_address != TRAMPOLINE && pi->page_address != TRAPFRAME){
-        _min = pi->loaded_at;
-        min_pi = pi;
-      }
-    }
-    pte = walk(p->pagetable,min_pi->page_address,0);
-    
-    if(*pte & PTE_A){
-      min_pi->loaded_at = get_next_turn(p);
-      *pte &= ~PTE_A;
-    } 
-    else{
-      break;
-    }
+  int n;
 
+  if(p->nram == 0)
+    return 0;
+  for(n = 0; n <= p->nram; n++){
+    pi = ram_page(p, p->clock_hand);
+    if((*pi->pte & PTE_V) && pi->page_address != TRAMPOLINE && pi->page_address != TRAPFRAME){
+      if((*pi->pte & PTE_A) == 0)
+        return pi;
+      *pi->pte &= ~PTE_A;
+    }
+    p->clock_hand = pi->next;
   }
-  return min_pi->page_address;
+  return 0;
 }
 
-uint64
-find_lapa(void){
-  struct proc *p = myproc();
+struct page_access_info*
+find_lapa(struct proc *p){
   uint _min = 32;
   struct page_access_info *pi;
   struct page_access_info *min_pi = 0;
-  for(pi=p->ram_pages; pi<&p->ram_pages[MAX_PSYC_PAGES]; pi++){
-    if(pi->in_use && (*walk(p->pagetable,pi->page_address,0) & PTE_V)&& pi->page_address != TRAMPOLINE && pi->page_address != TRAPFRAME){
+  int i;
+  for(i = 0; i < p->nram; i++){
+    pi = ram_page(p, i);
+    if((*pi->pte & PTE_V)&& pi->page_address != TRAMPOLINE && pi->page_address != TRAPFRAME){
       if(count_ones(pi->access_counter) < _min){
         _min = count_ones(pi->access_counter);
         min_pi = pi;
@@ -939,22 +1850,117 @@ find_lapa(void){
       }
     }
   }
-  return min_pi->page_address;
+  return min_pi;
 }
 
-pte_t*
-find_page_to_store(uint64* page_address){
-  struct proc *p = myproc();
-  switch(SELECTION){
-    case NFUA:
-      *page_address = find_nfu();
-      return walk(p->pagetable,*page_address,0);
-    case LAPA:
-      *page_address = find_lapa();
-      return walk(p->pagetable,*page_address,0);
-    case SCFIFO:
-      *page_address = find_scfifo();
-      return walk(p->pagetable,*page_address,0);
+// A scan-resistant clock in the style of CLOCK-Pro. Pages come
+// in cold, and only cold pages are evicted. A cold page turns
+// hot if it is referenced again after the hand has passed it
+// once (the first pass only sees the fault that loaded it), or
+// if it faults back in while a ghost of it is remembered. The
+// hand demotes unreferenced hot pages while more than
+// nram - cold_target are hot. A ghost hit grows cold_target,
+// and a cold page evicted without a second reference shrinks
+// it, so a scan is confined to a small cold pool and the hot
+// pages outlast it. update_access_counters() moves PTE_A into
+// the newest bit of access_counter, so that counts as a
+// reference too.
+struct page_access_info*
+find_clockpro(struct proc *p){
+  struct page_access_info *pi;
+  int n, ref;
+
+  if(p->nram == 0)
+    return 0;
+  for(n = 0; n <= 3*p->nram; n++){
+    pi = ram_page(p, p->clock_hand);
+    if((*pi->pte & PTE_V) == 0 || pi->page_address == TRAMPOLINE || pi->page_address == TRAPFRAME){
+      p->clock_hand = pi->next;
+      continue;
+    }
+    // the older samples are left for working_set().
+    ref = (*pi->pte & PTE_A) || (pi->access_counter & (1U << 31));
+    *pi->pte &= ~PTE_A;
+    pi->access_counter &= ~(1U << 31);
+    if(pi->hot){
+      if(!ref && p->nhot > p->nram - p->cold_target){
+        pi->hot = 0;
+        p->nhot--;
+      }
+    } else if(ref){
+      if(!pi->fresh){
+        pi->hot = 1;
+        p->nhot++;
+      }
+    } else {
+      if(!pi->fresh && p->cold_target > 1)
+        p->cold_target--;
+      return pi;
+    }
+    pi->fresh = 0;
+    p->clock_hand = pi->next;
+  }
+  // three laps turn up a cold page unless none is valid.
+  return 0;
+}
+
+// Replacement policies, indexed by SELECTION value.
+static struct {
+  char *name;
+  struct page_access_info* (*find)(struct proc*);
+} policies[] = {
+  [SCFIFO]   { "scfifo",   find_scfifo },
+  [NFUA]     { "nfua",     find_nfu },
+  [LAPA]     { "lapa",     find_lapa },
+  [CLOCKPRO] { "clockpro", find_clockpro },
+};
+
+// Switch p to the replacement policy called name.
+// Per-page policy state starts over, as if every resident
+// page had just been loaded. Returns 0, or -1.
+int
+setpolicy(struct proc *p, char *name){
+  struct page_access_info *pi;
+  int i, n;
+
+  for(n = 0; n < NELEM(policies); n++)
+    if(policies[n].name && strncmp(policies[n].name, name, 16) == 0)
+      break;
+  if(n == NELEM(policies))
+    return -1;
+
+  acquiresleep(&p->swap_lock);
+  for(i = 0; i < p->nram; i++){
+    pi = ram_page(p, i);
+    pi->access_counter = n == LAPA ? 4294967295 : 0;
+    pi->hot = 0;
+    pi->fresh = 1;
   }
+  p->nhot = 0;
+  p->cold_target = 1;
+  memset(p->ghost, 0, sizeof(p->ghost));
+  p->ghost_next = 0;
+  p->policy = n;
+  releasesleep(&p->swap_lock);
   return 0;
 }
+
+// Name of p's replacement policy, or "" if it has none.
+char*
+policyname(struct proc *p)
+{
+  if(p->policy < 0 || p->policy >= NELEM(policies) ||
+     policies[p->policy].name == 0)
+    return "";
+  return policies[p->policy].name;
+}
+
+struct page_access_info*
+find_page_to_store(struct proc *p){
+  struct page_access_info* (*find)(struct proc*);
+
+  if(p->policy < 0 || p->policy >= NELEM(policies) ||
+     (find = policies[p->policy].find) == 0)
+    return 0;
+  return find(p);
+}
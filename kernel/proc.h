@@ -82,19 +82,26 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
-struct storedpage{
-  int file_offset;             // Page's offest indisde file
-  uint64 page_address;         // Indetfire for pte
-  int in_use;                  // Indicate if is in use
-};
-
 struct page_access_info{
   uint64 page_address;             // Indetfire for pte
+  pte_t *pte;                      // PTE mapping the page
+  int slot;                        // Swap slot still holding a copy, or -1
   uint access_counter;             //Indicates the number of access to the page; 
-  uint64 loaded_at;                // Indicates the time the page was loaded to RAM; 
-  int in_use ; 
+  int prev, next;                  // Neighbours in the clock ring, by index
+  char hot;                        // CLOCKPRO: re-referenced, kept over cold pages
+  char fresh;                      // CLOCKPRO: not yet passed by the hand
 };
 
+// swap_bitmap is NSWAP bits from a slab cache, allocated on
+// the first swap-out, marking the swap area slots p holds a
+// reference to. ram_pages is kept in pages kalloc'd as
+// the resident set grows; entries [0, nram) are in use, and
+// are linked into a ring in the order they were loaded.
+#define RAM_PER_PAGE   (PGSIZE/sizeof(struct page_access_info))
+#define NRAMPAGES      16
+#define MAX_RSS_PAGES  (NRAMPAGES*RAM_PER_PAGE)
+#define NGHOST         32  // CLOCKPRO: evicted pages remembered
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -119,8 +126,44 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 
-  struct file *swapFile;
-  struct storedpage storedpages[MAX_TOTAL_PAGES];
-  struct page_access_info ram_pages[MAX_PSYC_PAGES];
-  uint64 page_turn;
+  struct sleeplock swap_lock;  // Protects swap_bitmap and ram_pages
+  uint64 *swap_bitmap;         // Swap slots referred to
+  struct page_access_info *ram_pages[NRAMPAGES];
+  int nram;                    // Number of resident pages
+  int rss_limit;               // Most resident pages before evicting
+  int wset_min;                // Resident pages global replacement leaves
+  int policy;                  // Replacement policy, a SELECTION value
+  int clock_hand;              // Oldest entry of the ram_pages ring
+  int nhot;                    // CLOCKPRO: hot resident pages
+  int cold_target;             // CLOCKPRO: resident pages to keep cold
+  uint64 ghost[NGHOST];        // CLOCKPRO: recently evicted pages, va|1
+  int ghost_next;              // CLOCKPRO: next ghost[] entry to reuse
+  int age_ticks;               // Ticks in user mode since the last access sample
+  int nswapped;                // Pages held only in the swap area
+
+  // p->lock must be held when using these:
+  int pageout;                 // If non-zero, pageout daemon is evicting; don't run
+  int user_preempted;          // If non-zero, yielded from user mode on a timer tick
+  int suspended;               // If non-zero, swapped out whole by pffd; don't run
+  int suspended_at;            // pffd interval it was suspended in
+
+  // swap_lock must be held when using these:
+  uint64 nfaults;              // Page faults served from the swap area
+  uint64 fault_time;           // Timer cycles spent serving them
+  uint64 sync_evictions;       // Evictions done in the faulting path
+  uint64 async_evictions;      // Evictions done by the pageout daemon
+  uint64 clean_evictions;      // Evictions that needed no swap write
+  uint64 readahead;            // Pages read in ahead of a fault
+  uint64 swap_ins;             // Pages loaded from the swap area
+  uint64 swap_outs;            // Pages written to it
+  uint64 load_time;            // Timer cycles spent in load_page()
+  uint64 store_time;           // Timer cycles spent in store_page()
+  uint64 ra_next;              // Page whose fault would continue a sequential scan
+  int ra_window;               // Pages to read ahead on that fault
+  uint64 pff_faults;           // nfaults when pffd last looked
+  int pff_want;                // More resident pages pffd would give
+
+  void (*kfunc)(void);         // Entry point, if this is a kernel thread
+  int lowprio;                 // If non-zero, run only when nothing else can
+  int logged;                  // Current FS op has called log_write()
 };
@@ -332,6 +332,8 @@ sfence_vma()
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
 #define PTE_A (1L << 6) // 1 -> user can access
+#define PTE_D (1L << 7) // 1 -> written since mapped, set by hardware
+#define PTE_COW (1L << 8) // shared copy-on-write, write access withheld
 #define PTE_PG (1L << 9) // Paged out to secondary storage 
 
 // shift a physical address to the right place for a PTE.
@@ -341,6 +343,11 @@ sfence_vma()
 
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+// a paged-out PTE keeps the page's swap slot
+// where a valid one keeps the physical page number.
+#define SLOT2PTE(slot) (((uint64)(slot)) << 10)
+#define PTE2SLOT(pte) ((pte) >> 10)
+
 // extract the three 9-bit page table indices from a virtual address.
 #define PXMASK          0x1FF // 9 bits
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
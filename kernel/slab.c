@@ -0,0 +1,215 @@
+// Slab allocator, for kernel objects smaller than a page.
+//
+// A cache hands out objects of one size, carved out of pages
+// (slabs) from kalloc(). Each slab starts with a struct slab
+// and keeps its free objects on a list; slabs with free
+// objects are on the cache's partial list.
+//
+// On top of the slabs, every CPU keeps a magazine of up to
+// MAGSIZE free objects of each cache, so most allocations and
+// frees take no lock at all. A CPU whose magazine runs empty
+// or full fills or empties half of it under the cache's lock.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "vmstat.h"
+
+#define NCACHE  8   // caches in the system
+#define MAGSIZE 16  // free objects a CPU keeps per cache
+
+struct obj {
+  struct obj *next;
+};
+
+struct slab {
+  struct slab *next;  // partial list
+  struct slab *prev;
+  struct obj *free;   // free objects in this slab
+  int nfree;
+};
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  int size;            // object size, rounded up to 8 bytes
+  int perslab;         // objects in a slab
+  struct slab *partial;
+  int nslab;           // pages held
+  struct {
+    int n;
+    void *obj[MAGSIZE];
+  } mag[NCPU];         // per-CPU magazines; interrupts off
+};
+
+struct {
+  struct spinlock lock;
+  struct kmem_cache cache[NCACHE];
+  int n;
+} slabs;
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+}
+
+// Set up a cache of objects of size bytes.
+struct kmem_cache*
+kmem_cache_create(char *name, int size)
+{
+  struct kmem_cache *c;
+
+  size = (size + 7) & ~7;
+  if(size < sizeof(struct obj) || size > PGSIZE - sizeof(struct slab))
+    panic("kmem_cache_create: size");
+
+  acquire(&slabs.lock);
+  if(slabs.n == NCACHE)
+    panic("kmem_cache_create: no caches");
+  c = &slabs.cache[slabs.n++];
+  release(&slabs.lock);
+
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - sizeof(struct slab)) / size;
+  return c;
+}
+
+static void
+partial_insert(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(s->next)
+    s->next->prev = s;
+  c->partial = s;
+}
+
+static void
+partial_remove(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Add a slab of free objects to c.
+// Caller must hold c->lock.
+static int
+slab_grow(struct kmem_cache *c)
+{
+  struct slab *s;
+  struct obj *o;
+  char *a;
+  int i;
+
+  if((s = (struct slab*)kalloc_nofill()) == 0)
+    return -1;
+  s->free = 0;
+  s->nfree = c->perslab;
+  a = (char*)(s + 1);
+  for(i = 0; i < c->perslab; i++){
+    o = (struct obj*)(a + i*c->size);
+    o->next = s->free;
+    s->free = o;
+  }
+  partial_insert(c, s);
+  c->nslab++;
+  return 0;
+}
+
+// Fill half of CPU id's magazine from c's slabs.
+static void
+mag_fill(struct kmem_cache *c, int id)
+{
+  struct slab *s;
+  struct obj *o;
+
+  acquire(&c->lock);
+  while(c->mag[id].n < MAGSIZE/2){
+    if(c->partial == 0 && slab_grow(c) < 0)
+      break;
+    s = c->partial;
+    o = s->free;
+    s->free = o->next;
+    if(--s->nfree == 0)
+      partial_remove(c, s);
+    c->mag[id].obj[c->mag[id].n++] = o;
+  }
+  release(&c->lock);
+}
+
+// Return half of CPU id's magazine to c's slabs, and give back
+// the pages of slabs that become empty, keeping one.
+static void
+mag_flush(struct kmem_cache *c, int id)
+{
+  struct slab *s;
+  struct obj *o;
+
+  acquire(&c->lock);
+  while(c->mag[id].n > MAGSIZE/2){
+    o = c->mag[id].obj[--c->mag[id].n];
+    s = (struct slab*)PGROUNDDOWN((uint64)o);
+    o->next = s->free;
+    s->free = o;
+    if(s->nfree++ == 0)
+      partial_insert(c, s);
+    if(s->nfree == c->perslab && (s->next || s->prev)){
+      partial_remove(c, s);
+      c->nslab--;
+      kfree((void*)s);
+    }
+  }
+  release(&c->lock);
+}
+
+// Allocate an object from c.
+// Returns 0 if memory cannot be allocated.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  void *o = 0;
+  int id;
+
+  push_off();
+  id = cpuid();
+  if(c->mag[id].n == 0)
+    mag_fill(c, id);
+  if(c->mag[id].n > 0)
+    o = c->mag[id].obj[--c->mag[id].n];
+  pop_off();
+  return o;
+}
+
+// Free an object allocated from c.
+void
+kmem_cache_free(struct kmem_cache *c, void *o)
+{
+  int id;
+
+  push_off();
+  id = cpuid();
+  if(c->mag[id].n == MAGSIZE)
+    mag_flush(c, id);
+  c->mag[id].obj[c->mag[id].n++] = o;
+  pop_off();
+}
+
+// Pages held by all caches. Only a hint.
+void
+slabstat(struct vmstat *st)
+{
+  int i;
+
+  st->slab_pages = 0;
+  for(i = 0; i < slabs.n; i++)
+    st->slab_pages += slabs.cache[i].nslab;
+}
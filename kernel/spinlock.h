@@ -5,5 +5,6 @@ struct spinlock {
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+  uint ncontended;   // Acquires that found the lock held.
 };
 
@@ -0,0 +1,201 @@
+// Swap area.
+//
+// mkfs sets aside sb.nswap pages of the disk, after the free
+// bit map, for paging out user memory. A swapped-out page lives
+// in a page-sized slot there, which carries a reference count:
+// a forked child shares its parent's slots, and a slot is
+// reused only once no process refers to it.
+//
+// Swap data needs no crash recovery, so it bypasses the log,
+// and is read once per fault, so it bypasses the buffer cache
+// too: each page goes to or from the disk in one virtio
+// request, straight from its frame. With SWAP_RAW 0 it goes
+// through the buffer cache a block at a time instead, to
+// compare the cost, which swapstat() reports.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+#include "vmstat.h"
+
+#define BPP (PGSIZE / BSIZE)  // blocks per page
+
+struct {
+  struct spinlock lock;
+  uint dev;
+  uint start;        // first block of the swap area
+  int nslot;         // slots in the swap area
+  int nfree;         // slots with no references
+  int next;          // where swapalloc() starts looking
+  uchar ref[NSWAP];  // references to each slot; at most NPROC
+
+  // I/O counters, for swapstat().
+  uint64 reads;
+  uint64 writes;
+  uint64 read_time;  // timer cycles
+  uint64 write_time;
+} swap;
+
+void
+swapinit(int dev, struct superblock *sb)
+{
+  initlock(&swap.lock, "swap");
+  swap.dev = dev;
+  swap.start = sb->swapstart;
+  swap.nslot = sb->nswap < NSWAP ? sb->nswap : NSWAP;
+  swap.nfree = swap.nslot;
+}
+
+// Allocate a free slot, with one reference.
+// Returns -1 if the swap area is full.
+int
+swapalloc(void)
+{
+  int i, slot;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    slot = (swap.next + i) % swap.nslot;
+    if(swap.ref[slot] == 0){
+      swap.ref[slot] = 1;
+      swap.nfree--;
+      swap.next = slot + 1;
+      release(&swap.lock);
+      return slot;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Add a reference to slot, to share it.
+void
+swapdup(int slot)
+{
+  acquire(&swap.lock);
+  if(slot < 0 || slot >= swap.nslot || swap.ref[slot] == 0)
+    panic("swapdup");
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// Drop a reference to slot.
+void
+swapfree(int slot)
+{
+  acquire(&swap.lock);
+  if(slot < 0 || slot >= swap.nslot || swap.ref[slot] == 0)
+    panic("swapfree");
+  if(--swap.ref[slot] == 0)
+    swap.nfree++;
+  release(&swap.lock);
+}
+
+// Number of references to slot. Only the caller's own
+// reference can go away underneath it.
+int
+swaprefs(int slot)
+{
+  return swap.ref[slot];
+}
+
+static void
+swaprw(char *pa, int slot, int write)
+{
+  struct buf *b[BPP];
+  int i;
+
+  if(SWAP_RAW){
+    virtio_disk_rwpage(swap.start + slot*BPP, pa, write);
+    return;
+  }
+  for(i = 0; i < BPP; i++){
+    b[i] = bread(swap.dev, swap.start + slot*BPP + i);
+    if(write)
+      memmove(b[i]->data, pa + i*BSIZE, BSIZE);
+    else
+      memmove(pa + i*BSIZE, b[i]->data, BSIZE);
+  }
+  // the page's blocks are consecutive: one request.
+  if(write)
+    bwritev(b, BPP);
+  for(i = 0; i < BPP; i++)
+    brelse(b[i]);
+}
+
+// Read the page in slot into the frame at pa.
+void
+swapread(char *pa, int slot)
+{
+  uint64 t0 = r_time();
+
+  swaprw(pa, slot, 0);
+  acquire(&swap.lock);
+  swap.reads++;
+  swap.read_time += r_time() - t0;
+  release(&swap.lock);
+}
+
+// Read the pages in slot[0..n-1] into the frames at pa[0..n-1].
+// With SWAP_RAW, the reads are queued together and the disk
+// is notified once; a run of consecutive slots is one request.
+void
+swapread_batch(char **pa, int *slot, int n)
+{
+  uint64 t0 = r_time();
+  int busy[SWAP_READAHEAD];
+  int i, j;
+
+  if(n > SWAP_READAHEAD)
+    panic("swapread_batch");
+  if(SWAP_RAW){
+    for(i = 0; i < n; i = j){
+      for(j = i+1; j < n && j-i < DISK_NSEG && slot[j] == slot[i] + (j-i); j++)
+        busy[j] = 0;
+      virtio_disk_startv(swap.start + slot[i]*BPP, (void**)&pa[i], j-i,
+                         PGSIZE, 0, &busy[i]);
+    }
+    virtio_disk_kick();
+    for(i = 0; i < n; i++)
+      virtio_disk_wait(&busy[i]);
+  } else {
+    for(i = 0; i < n; i++)
+      swaprw(pa[i], slot[i], 0);
+  }
+  acquire(&swap.lock);
+  swap.reads += n;
+  swap.read_time += r_time() - t0;
+  release(&swap.lock);
+}
+
+// Write the frame at pa to slot.
+void
+swapwrite(char *pa, int slot)
+{
+  uint64 t0 = r_time();
+
+  swaprw(pa, slot, 1);
+  acquire(&swap.lock);
+  swap.writes++;
+  swap.write_time += r_time() - t0;
+  release(&swap.lock);
+}
+
+// Fill in the system-wide swap I/O counters of st.
+void
+swapstat(struct vmstat *st)
+{
+  acquire(&swap.lock);
+  st->swap_reads = swap.reads;
+  st->swap_writes = swap.writes;
+  st->swap_read_time = swap.read_time;
+  st->swap_write_time = swap.write_time;
+  st->swap_slots = swap.nslot;
+  st->swap_free = swap.nfree;
+  release(&swap.lock);
+}
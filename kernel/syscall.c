@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
@@ -104,6 +105,10 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_getvmstat(void);
+extern uint64 sys_setrss(void);
+extern uint64 sys_setpolicy(void);
+extern uint64 sys_getvmstats(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,6 +132,10 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_getvmstat] sys_getvmstat,
+[SYS_setrss]   sys_setrss,
+[SYS_setpolicy] sys_setpolicy,
+[SYS_getvmstats] sys_getvmstats,
 };
 
 void
@@ -20,3 +20,7 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_getvmstat 22
+#define SYS_setrss 23
+#define SYS_setpolicy 24
+#define SYS_getvmstats 25
@@ -5,6 +5,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 
 uint64
@@ -95,3 +96,47 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+uint64
+sys_getvmstat(void)
+{
+  int pid;
+  uint64 st; // user pointer to struct vmstat
+
+  if(argint(0, &pid) < 0 || argaddr(1, &st) < 0)
+    return -1;
+  return getvmstat(pid, st);
+}
+
+// paging counters of every process, up to n of them.
+uint64
+sys_getvmstats(void)
+{
+  uint64 st; // user pointer to struct vmstat[n]
+  int n;
+
+  if(argaddr(0, &st) < 0 || argint(1, &n) < 0)
+    return -1;
+  return getvmstats(st, n);
+}
+
+// set the calling process's resident-set limit, in pages.
+uint64
+sys_setrss(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return setrss(myproc(), n);
+}
+
+uint64
+sys_setpolicy(void)
+{
+  char name[16];
+
+  if(argstr(0, name, sizeof(name)) < 0)
+    return -1;
+  return setpolicy(myproc(), name);
+}
@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
 
@@ -66,6 +67,8 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 15 && cow_fault(p->pagetable, r_stval()) == 0){
+    // wrote to a copy-on-write page, now a private copy
   } else if ((r_scause() == 13 || r_scause() == 15 || r_scause() == 12) && SELECTION != NONE && p->pid > 2){
     // page_fault
     uint64 va = r_stval();
@@ -78,9 +81,7 @@ usertrap(void)
       p->killed = 1;
     }
     else{
-      uint64 page_address;
-      pte_t* ppte = find_page_to_store(&page_address);
-      if(store_page(ppte,page_address) < 0 || load_page(va) < 0){
+      if(swap_in(p, va) < 0){
         printf("usertrap(): sigfault scause %p pid=%d\n", r_scause(), p->pid);
         printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
         p->killed = 1;
@@ -100,7 +101,7 @@ usertrap(void)
 
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2)
-    yield();
+    preempt();
 
   usertrapret();
 }
@@ -56,12 +56,13 @@ static struct disk {
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
   uint16 used_idx; // we've looked this far in used[2..NUM].
+  int unkicked;    // requests queued since the last notify
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    int *done;   // cleared, and woken up, on completion
     char status;
   } info[NUM];
 
@@ -184,12 +185,13 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
+// disk transfers use one for the header, one per data
+// segment, and one for the status.
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -200,27 +202,51 @@ alloc3_desc(int *idx)
   return 0;
 }
 
+// Tell the device about the requests queued since last time.
+// Caller must hold vdisk_lock.
+static void
+kick(void)
+{
+  if(disk.unkicked == 0)
+    return;
+  __sync_synchronize();
+  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  disk.unkicked = 0;
+}
+
+// Queue a request to read or write the n segments of len bytes
+// at data[0..n-1] from or to consecutive disk blocks starting
+// at blockno, and return without waiting. *busy is set until
+// the device is done with all of them. The device sees the
+// request at the next virtio_disk_kick(), so that a batch of
+// requests costs one notification.
 void
-virtio_disk_rw(struct buf *b, int write)
+virtio_disk_startv(uint blockno, void **data, int n, uint len, int write, int *busy)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  uint64 sector = blockno * (BSIZE / 512);
+  int i;
+
+  if(n < 1 || n > DISK_NSEG)
+    panic("virtio_disk_startv");
 
   acquire(&disk.vdisk_lock);
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // a descriptor for type/reserved/sector, then the data, in as
+  // many descriptors as it takes, then one for a 1-byte status.
 
-  // allocate the three descriptors.
-  int idx[3];
+  // allocate the descriptors.
+  int idx[DISK_NSEG+2];
   while(1){
-    if(alloc3_desc(idx) == 0) {
+    if(alloc_descs(idx, n+2) == 0) {
       break;
     }
+    // the queue is full; have the device work through it.
+    kick();
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
@@ -237,24 +263,26 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(i = 1; i <= n; i++){
+    disk.desc[idx[i]].addr = (uint64) data[i-1];
+    disk.desc[idx[i]].len = len;
+    if(write)
+      disk.desc[idx[i]].flags = 0; // device reads data
+    else
+      disk.desc[idx[i]].flags = VRING_DESC_F_WRITE; // device writes data
+    disk.desc[idx[i]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[i]].next = idx[i+1];
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the busy flag for virtio_disk_intr().
+  *busy = 1;
+  disk.info[idx[0]].done = busy;
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -263,20 +291,82 @@ virtio_disk_rw(struct buf *b, int write)
 
   // tell the device another avail ring entry is available.
   disk.avail->idx += 1; // not % NUM ...
+  disk.unkicked++;
 
-  __sync_synchronize();
+  release(&disk.vdisk_lock);
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// Queue a request for the len bytes at data, in one segment.
+void
+virtio_disk_start(uint blockno, void *data, uint len, int write, int *busy)
+{
+  virtio_disk_startv(blockno, &data, 1, len, write, busy);
+}
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+// Hand the queued requests to the device.
+void
+virtio_disk_kick(void)
+{
+  acquire(&disk.vdisk_lock);
+  kick();
+  release(&disk.vdisk_lock);
+}
+
+// Wait for the request that set *busy to finish,
+// handing it to the device first if need be.
+void
+virtio_disk_wait(int *busy)
+{
+  acquire(&disk.vdisk_lock);
+  kick();
+  while(*busy == 1) {
+    sleep(busy, &disk.vdisk_lock);
   }
+  release(&disk.vdisk_lock);
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+// Queue a read or write of b. See virtio_disk_start().
+void
+virtio_disk_submit(struct buf *b, int write)
+{
+  virtio_disk_start(b->blockno, b->data, BSIZE, write, &b->disk);
+}
 
-  release(&disk.vdisk_lock);
+// Queue a read or write of the data of bufs bs[0..n-1] from or
+// to consecutive blocks starting at blockno, as one request.
+// bs[0]->disk is set until all of them are done; the others'
+// are left clear.
+void
+virtio_disk_submitv(struct buf **bs, int n, uint blockno, int write)
+{
+  void *data[DISK_NSEG];
+  int i;
+
+  if(n < 1 || n > DISK_NSEG)
+    panic("virtio_disk_submitv");
+  for(i = 0; i < n; i++){
+    data[i] = bs[i]->data;
+    bs[i]->disk = 0;
+  }
+  virtio_disk_startv(blockno, data, n, BSIZE, write, &bs[0]->disk);
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(b, write);
+  virtio_disk_wait(&b->disk);
+}
+
+// Move a page of memory at pa to or from the disk blocks
+// starting at blockno, in one request, with no buffer cache.
+void
+virtio_disk_rwpage(uint blockno, char *pa, int write)
+{
+  int busy;
+
+  virtio_disk_start(blockno, pa, PGSIZE, write, &busy);
+  virtio_disk_wait(&busy);
 }
 
 void
@@ -304,9 +394,11 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    int *done = disk.info[id].done;
+    disk.info[id].done = 0;
+    free_chain(id);
+    *done = 0;   // disk is done with the data
+    wakeup(done);
 
     disk.used_idx += 1;
   }
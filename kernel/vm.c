@@ -4,6 +4,7 @@
 #include "elf.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
 #include "fs.h"
@@ -23,8 +24,7 @@ kvmmake(void)
 {
   pagetable_t kpgtbl;
 
-  kpgtbl = (pagetable_t) kalloc();
-  memset(kpgtbl, 0, PGSIZE);
+  kpgtbl = (pagetable_t) kalloc_zeroed();
 
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -90,36 +90,69 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
     if(*pte & PTE_V) {
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
   return &pagetable[PX(0, va)];
 }
 
-// Look up a virtual address, return the physical address,
-// or 0 if not mapped.
-// Can only be used to look up user pages.
-uint64
-walkaddr(pagetable_t pagetable, uint64 va)
+// Return the PTE of the user page holding va, or 0 if it is
+// not mapped. A page the current process has swapped out is
+// faulted back in first, which sleeps; a caller that holds a
+// spinlock gets 0 instead, and should have used uvmfaultin().
+static pte_t*
+walkuser(pagetable_t pagetable, uint64 va)
 {
+  struct proc *p = myproc();
   pte_t *pte;
-  uint64 pa;
+  int locked;
 
   if(va >= MAXVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
+  while((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_PG)){
+    push_off();
+    locked = mycpu()->noff > 1;
+    pop_off();
+    if(p == 0 || p->pagetable != pagetable || locked)
+      return 0;
+    if(swap_in(p, va) < 0)
+      return 0;
+  }
   if(pte == 0)
     return 0;
   if((*pte & PTE_V) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
-  return pa;
+  return pte;
+}
+
+// Look up a virtual address, return the physical address,
+// or 0 if not mapped.
+// Can only be used to look up user pages.
+uint64
+walkaddr(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+
+  if((pte = walkuser(pagetable, va)) == 0)
+    return 0;
+  return PTE2PA(*pte);
+}
+
+// Fault in the swapped-out pages of the user range
+// [va, va+len), before copying to or from it where
+// swap_in() cannot run.
+void
+uvmfaultin(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  uint64 a;
+
+  for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE)
+    walkuser(pagetable, a);
 }
 
 // add a mapping to the kernel page table.
@@ -158,12 +191,11 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
-// Create PTEs for virtual addresses starting at va that refer to
-// physical addresses starting at pa. va and size might not
-// be page-aligned. Returns 0 on success, -1 if walk() couldn't
-// allocate a needed page-table page.
+// Create a paged-out PTE for the page at va, a copy of swappte,
+// which names the page's swap slot. Returns 0 on success, -1 if
+// walk() couldn't allocate a needed page-table page.
 int
-mapdiskpages(pagetable_t pagetable, uint64 va, int perm)
+mapdiskpages(pagetable_t pagetable, uint64 va, pte_t swappte)
 {
   uint64 a, last;
   pte_t *pte;
@@ -175,7 +207,7 @@ mapdiskpages(pagetable_t pagetable, uint64 va, int perm)
       return -1;
     if(*pte & PTE_V)
       panic("remap");
-    *pte = perm | PTE_PG;
+    *pte = swappte | PTE_PG;
     if(a == last)
       break;
     a += PGSIZE;
@@ -216,10 +248,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -233,8 +264,7 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -247,48 +277,34 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
   // printf("executing uvmalloc..\n");
   char *mem;
   uint64 a;
-  uint64 page_address;
   struct proc *p = myproc();
 
   if(newsz < oldsz)
     return oldsz;
-  int pid = p->pid;
+  // exec() builds the new image in a fresh page table,
+  // which takes no part in paging until it is committed.
+  int paging = swapping(p) && pagetable == p->pagetable;
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
     // in case there is no more physical memory
-    if(a >= MAX_PSYC_PAGES*PGSIZE && pid > 2 && SELECTION != NONE){
-      pte_t *pte = find_page_to_store(&page_address);
-      if(store_page(pte,page_address) < 0){
-        return 0;
-      }
+    if(paging && ((free_ram_slots(p) <= 0 && evict_page(p) < 0) ||
+                  reserve_ram_page(p) < 0)){
+      uvmdealloc(pagetable, a, oldsz);
+      return 0;
     }
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    
-    struct page_access_info* pi;
-    for(pi=p->ram_pages; pi<&p->ram_pages[MAX_PSYC_PAGES]; pi++){
-      if(pi->in_use == 0){
-        pi->page_address = a ; 
-        pi->loaded_at = get_next_turn(p);
-        pi->in_use = 1;
-        if(SELECTION == LAPA)
-          pi->access_counter = 4294967295;
-        else
-          pi->access_counter = 0;
-        break;
-      }
-  }
-  
+    if(paging)
+      add_ram_page(p, a, walk(pagetable, a, 0), -1);
   }
   return newsz;
 }
@@ -300,19 +316,17 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 uint64
 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
-  uint64 va;
-  pte_t *pte;
+  struct proc *p = myproc();
+
   if(newsz >= oldsz)
     return oldsz;
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    va = PGROUNDUP(newsz);
-    pte = walk(pagetable,va,0);
-    if(!(*pte & PTE_PG))
-      uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
-    else
-      uvmunmap(pagetable, PGROUNDUP(newsz), npages, 0);
+    if(swapping(p) && pagetable == p->pagetable)
+      remove_pages(p, PGROUNDUP(newsz), PGROUNDUP(oldsz));
+    // uvmunmap() frees only the resident pages.
+    uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
   }
 
   return newsz;
@@ -350,8 +364,8 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Copies the page table; resident pages are
+// shared copy-on-write, see cow_fault().
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
@@ -360,7 +374,6 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   pte_t *pte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
@@ -368,21 +381,19 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
     if((*pte & PTE_V) == 0 && (*pte & PTE_PG) == 0)
       panic("uvmcopy: page not present");
     if ((*pte & PTE_PG) != 0){
-      flags = PTE_FLAGS(*pte);
-      if(mapdiskpages(new, i, flags) != 0){
+      if(mapdiskpages(new, i, *pte) != 0){
         goto err;
       }
     }
     else{
+      // share the page, copy-on-write if it is writable.
+      if(*pte & PTE_W)
+        *pte = (*pte & ~PTE_W) | PTE_COW;
       pa = PTE2PA(*pte);
       flags = PTE_FLAGS(*pte);
-      if((mem = kalloc()) == 0)
+      if(mappages(new, i, PGSIZE, pa, flags) != 0)
         goto err;
-      memmove(mem, (char*)pa, PGSIZE);
-      if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-        kfree(mem);
-        goto err;
-      }
+      kdup((void*)pa);
     }
   }
   return 0;
@@ -392,6 +403,33 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// Give the page holding va its own writable copy, after a
+// write to a page shared copy-on-write. The last sharer keeps
+// the page itself. Returns -1 if va is not such a page, or if
+// out of memory.
+int
+cow_fault(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  char *mem;
+
+  if(va >= MAXVA || (pte = walk(pagetable, va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  if(krefs((void*)pa) > 1){
+    if((mem = kalloc_nofill()) == 0)
+      return -1;
+    memmove(mem, (char*)pa, PGSIZE);
+    *pte = PA2PTE(mem) | PTE_FLAGS(*pte);
+    kfree((void*)pa);
+  }
+  *pte = (*pte & ~PTE_COW) | PTE_W;
+  return 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -412,12 +450,17 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pte = walkuser(pagetable, va0)) == 0)
+      return -1;
+    if((*pte & PTE_COW) && cow_fault(pagetable, va0) < 0)
       return -1;
+    // the hardware sets PTE_D only for stores from user mode.
+    *pte |= PTE_D;
+    pa0 = PTE2PA(*pte);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
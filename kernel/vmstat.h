@@ -0,0 +1,42 @@
+// Paging counters of a process, and swap I/O and
+// allocator counters of the whole system, filled in
+// by getvmstat().
+struct vmstat {
+  int pid;
+  char name[16];
+  int resident;           // Pages in RAM
+  int swapped;            // Pages only in the swap area
+  int rss_limit;          // Most resident pages before evicting
+  char policy[16];        // Replacement policy, as setpolicy() names it
+  uint64 faults;          // Page faults served from the swap area
+  uint64 fault_time;      // Timer cycles spent serving them
+  uint64 sync_evictions;  // Evictions done in the faulting path
+  uint64 async_evictions; // Evictions done by the pageout daemon
+  uint64 clean_evictions; // Evictions that needed no swap write
+  uint64 readahead;       // Pages read in ahead of a fault
+  uint64 swap_ins;        // Pages loaded from the swap area
+  uint64 swap_outs;       // Pages written to it
+  uint64 load_time;       // Timer cycles spent loading pages
+  uint64 store_time;      // Timer cycles spent storing them
+
+  uint64 swap_reads;      // Pages read from the swap area
+  uint64 swap_writes;     // Pages written to it
+  uint64 swap_read_time;  // Timer cycles spent reading
+  uint64 swap_write_time; // Timer cycles spent writing
+  int swap_slots;         // Page slots in the swap area
+  int swap_free;          // Of which not in use
+  int free_pages;         // Free physical pages
+  uint64 kalloc_refills;  // Batches of free pages a CPU took from the pool
+  uint64 kalloc_steals;   // Batches it took from another CPU
+  uint64 kalloc_spills;   // Batches it gave back to the pool
+  uint64 kalloc_contended; // Allocator lock acquires that had to spin
+  int free_blocks[KORDERS]; // Free blocks of 2^i pages in the pool
+  int zeroed_pages;       // Free pages kept zero-filled
+  int slab_pages;         // Pages holding small kernel objects
+  int nbuf;               // Buffers in the disk block cache
+  uint64 bcache_hits;     // Block lookups found cached
+  uint64 bcache_misses;   // Block lookups that recycled a buffer
+  uint64 bcache_contended; // Cache lock acquires that had to spin
+  uint64 zeroed_hits;     // Zeroed allocations served from them
+  uint64 zeroed_misses;   // Zeroed allocations that zeroed a page
+};
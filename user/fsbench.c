@@ -0,0 +1,102 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "kernel/vmstat.h"
+#include "user/user.h"
+
+// Read distinct files from 1 up to N processes at once
+// (default 4; run with N at least the number of harts), with
+// the files cached, so that the cost is in looking blocks up
+// in the buffer cache. Reports blocks read per tick, and the
+// buffer cache's hits, misses and lock contention.
+
+#define BLOCKS 64   // blocks per file
+#define PASSES 20
+
+char buf[BSIZE];
+
+static void
+name(char *s, int i)
+{
+  strcpy(s, "fsbench0");
+  s[7] = '0' + i;
+}
+
+static void
+reader(int i)
+{
+  char path[16];
+  int fd, j, k;
+
+  name(path, i);
+  for(j = 0; j < PASSES; j++){
+    if((fd = open(path, O_RDONLY)) < 0)
+      exit(1);
+    for(k = 0; k < BLOCKS; k++){
+      if(read(fd, buf, BSIZE) != BSIZE)
+        exit(1);
+    }
+    close(fd);
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat before, after;
+  char path[16];
+  int max = 4, n, i, fd, t0, t, status, ok;
+
+  if(argc > 1)
+    max = atoi(argv[1]);
+  if(max < 1 || max > 10){
+    fprintf(2, "usage: fsbench [nprocs]\n");
+    exit(1);
+  }
+
+  for(i = 0; i < max; i++){
+    name(path, i);
+    if((fd = open(path, O_CREATE|O_RDWR)) < 0){
+      fprintf(2, "fsbench: cannot create %s\n", path);
+      exit(1);
+    }
+    memset(buf, 'a' + i, BSIZE);
+    for(n = 0; n < BLOCKS; n++)
+      write(fd, buf, BSIZE);
+    close(fd);
+  }
+
+  for(n = 1; n <= max; n++){
+    getvmstat(getpid(), &before);
+    t0 = uptime();
+    for(i = 0; i < n; i++){
+      if(fork() == 0)
+        reader(i);
+    }
+    ok = 1;
+    for(i = 0; i < n; i++){
+      if(wait(&status) < 0 || status != 0)
+        ok = 0;
+    }
+    t = uptime() - t0;
+    getvmstat(getpid(), &after);
+    if(!ok){
+      printf("fsbench: %d procs: FAILED\n", n);
+      exit(1);
+    }
+    printf("%d procs: %d blocks in %d ticks, %d per tick; "
+           "%d hits, %d misses, %d contended\n",
+           n, n * BLOCKS * PASSES, t, n * BLOCKS * PASSES / (t ? t : 1),
+           (int)(after.bcache_hits - before.bcache_hits),
+           (int)(after.bcache_misses - before.bcache_misses),
+           (int)(after.bcache_contended - before.bcache_contended));
+  }
+
+  for(i = 0; i < max; i++){
+    name(path, i);
+    unlink(path);
+  }
+  exit(0);
+}
@@ -0,0 +1,83 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/vmstat.h"
+#include "user/user.h"
+
+// Stress the page allocator from 1 up to N processes at once
+// (default NCPU). Each grows its heap by PAGES pages with
+// sbrk(), stamps and checks every page, and shrinks it again.
+// Reports pages allocated and freed per tick, and how often the
+// allocator had to go to the shared pool, steal from another
+// CPU, or spin on a lock. The results are per process count:
+// processes only run on separate harts up to the number the
+// kernel was booted with (CPUS in the Makefile, at most NCPU).
+
+#define PGSIZE 4096
+#define PAGES  32
+#define ROUNDS 200
+
+static void
+worker(int id)
+{
+  char *mem;
+  int i, j;
+
+  if(setrss(PAGES + MAX_PSYC_PAGES) < 0)
+    exit(1);
+  for(j = 0; j < ROUNDS; j++){
+    if((mem = sbrk(PAGES * PGSIZE)) == (char*)-1)
+      exit(1);
+    for(i = 0; i < PAGES; i++)
+      *(int*)(mem + i*PGSIZE) = id*ROUNDS + j;
+    for(i = 0; i < PAGES; i++){
+      if(*(int*)(mem + i*PGSIZE) != id*ROUNDS + j)
+        exit(1);
+    }
+    sbrk(-PAGES * PGSIZE);
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat before, after;
+  int max = NCPU, n, i, t0, t, status, ok;
+
+  if(argc > 1)
+    max = atoi(argv[1]);
+  if(max < 1 || max > NPROC/2){
+    fprintf(2, "usage: kallocbench [nprocs]\n");
+    exit(1);
+  }
+
+  printf("kallocbench: %d pages x %d rounds per process, NCPU %d\n",
+         PAGES, ROUNDS, NCPU);
+  for(n = 1; n <= max; n++){
+    getvmstat(getpid(), &before);
+    t0 = uptime();
+    for(i = 0; i < n; i++){
+      if(fork() == 0)
+        worker(i);
+    }
+    ok = 1;
+    for(i = 0; i < n; i++){
+      if(wait(&status) < 0 || status != 0)
+        ok = 0;
+    }
+    t = uptime() - t0;
+    getvmstat(getpid(), &after);
+    if(!ok){
+      printf("kallocbench: %d procs: FAILED\n", n);
+      exit(1);
+    }
+    printf("%d procs: %d pages in %d ticks, %d per tick; "
+           "%d refills, %d steals, %d spills, %d contended\n",
+           n, n * PAGES * ROUNDS, t, n * PAGES * ROUNDS / (t ? t : 1),
+           (int)(after.kalloc_refills - before.kalloc_refills),
+           (int)(after.kalloc_steals - before.kalloc_steals),
+           (int)(after.kalloc_spills - before.kalloc_spills),
+           (int)(after.kalloc_contended - before.kalloc_contended));
+  }
+  exit(0);
+}
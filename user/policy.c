@@ -0,0 +1,22 @@
+// Run a command under a given page replacement policy,
+// e.g. "policy nfua swapbench".
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if(argc < 3){
+    fprintf(2, "usage: policy scfifo|nfua|lapa|clockpro command [args...]\n");
+    exit(1);
+  }
+  if(setpolicy(argv[1]) < 0){
+    fprintf(2, "policy: cannot switch to %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "policy: exec %s failed\n", argv[2]);
+  exit(1);
+}
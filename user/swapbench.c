@@ -0,0 +1,100 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/vmstat.h"
+#include "user/user.h"
+
+// Scan a region twice the size of the resident set, page by
+// page, in order and in random order, and report how many
+// page faults each costs per MB touched. Readahead should cut
+// the faults of the sequential scan, and stay out of the way
+// of the random one. A third run keeps reusing a small hot set
+// while scanning the rest, which a scan-resistant policy
+// ("policy clockpro swapbench") should serve with fewer faults than
+// SCFIFO, NFUA or LAPA. Also reports what a page read from and
+// written to the swap area costs, in timer cycles; build with
+// RAWSWAP=0 to compare with swapping through the buffer cache.
+
+#define PGSIZE 4096
+#define NPAGES (2*MAX_PSYC_PAGES)
+#define PASSES 16
+#define HOT    (MAX_PSYC_PAGES/2)  // pages in the hot set
+
+static uint seed = 1;
+
+static uint
+rand(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7fff;
+}
+
+static void
+report(char *name, int pages, struct vmstat *before, struct vmstat *after, int ticks)
+{
+  int kb = pages * (PGSIZE / 1024);
+  int faults = after->faults - before->faults;
+  int ra = after->readahead - before->readahead;
+
+  int reads = after->swap_reads - before->swap_reads;
+  int writes = after->swap_writes - before->swap_writes;
+
+  printf("%s: %d faults, %d read ahead, %d KB in %d ticks, %d faults/MB\n",
+         name, faults, ra, kb, ticks, faults * 1024 / kb);
+  printf("%s: %d swap reads, %d cycles each; %d swap writes, %d cycles each\n",
+         name, reads,
+         reads ? (int)((after->swap_read_time - before->swap_read_time) / reads) : 0,
+         writes,
+         writes ? (int)((after->swap_write_time - before->swap_write_time) / writes) : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat before, after;
+  char *mem;
+  int i, j, k, t0, n;
+  int sum = 0;
+
+  mem = sbrk(NPAGES * PGSIZE);
+  if(mem == (char*)-1){
+    printf("swapbench: sbrk failed\n");
+    exit(1);
+  }
+  for(i = 0; i < NPAGES; i++)
+    mem[i * PGSIZE] = i;
+
+  getvmstat(getpid(), &before);
+  t0 = uptime();
+  for(j = 0; j < PASSES; j++)
+    for(i = 0; i < NPAGES; i++)
+      sum += mem[i * PGSIZE];
+  getvmstat(getpid(), &after);
+  report("sequential", NPAGES * PASSES, &before, &after, uptime() - t0);
+
+  getvmstat(getpid(), &before);
+  t0 = uptime();
+  for(j = 0; j < PASSES; j++)
+    for(i = 0; i < NPAGES; i++)
+      sum += mem[(rand() % NPAGES) * PGSIZE];
+  getvmstat(getpid(), &after);
+  report("random", NPAGES * PASSES, &before, &after, uptime() - t0);
+
+  // hot set in the first HOT pages, scan over the rest.
+  getvmstat(getpid(), &before);
+  t0 = uptime();
+  n = 0;
+  for(j = 0; j < PASSES; j++){
+    for(i = HOT; i < NPAGES; i++){
+      sum += mem[i * PGSIZE];
+      for(k = 0; k < HOT; k++)
+        sum += mem[k * PGSIZE];
+      n += 1 + HOT;
+    }
+  }
+  getvmstat(getpid(), &after);
+  report("hot+scan", n, &before, &after, uptime() - t0);
+
+  if(sum == 0)
+    printf("swapbench: bad sum\n");
+  exit(0);
+}
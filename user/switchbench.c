@@ -0,0 +1,62 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+// Bounce a byte between two processes over a pair of pipes,
+// so that every round trip costs two context switches, and
+// report round trips per tick. Both processes first fill
+// their resident set, which used to make every switch back
+// to the scheduler walk the page table once per page.
+
+#define PGSIZE 4096
+#define ROUNDS 20000
+
+static void
+touch(char *mem)
+{
+  int i;
+
+  for(i = 0; i < MAX_PSYC_PAGES; i++)
+    mem[i * PGSIZE] = i;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ping[2], pong[2];
+  int i, pid, t0, t;
+  char *mem, c = 0;
+
+  mem = sbrk(MAX_PSYC_PAGES * PGSIZE);
+  if(mem == (char*)-1 || pipe(ping) < 0 || pipe(pong) < 0){
+    printf("switchbench: setup failed\n");
+    exit(1);
+  }
+  touch(mem);
+
+  if((pid = fork()) < 0){
+    printf("switchbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    touch(mem);
+    for(i = 0; i < ROUNDS; i++){
+      if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1)
+        exit(1);
+    }
+    exit(0);
+  }
+
+  t0 = uptime();
+  for(i = 0; i < ROUNDS; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf("switchbench: pipe failed\n");
+      exit(1);
+    }
+  }
+  t = uptime() - t0;
+  wait(0);
+  printf("switchbench: %d round trips in %d ticks, %d per tick\n",
+         ROUNDS, t, t ? ROUNDS / t : ROUNDS);
+  exit(0);
+}
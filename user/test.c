@@ -2,6 +2,8 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/param.h"
+#include "kernel/fcntl.h"
+#include "kernel/vmstat.h"
 
 #define PGSIZE 4096
 
@@ -171,12 +173,213 @@ int test_fork(void){
     return all_pass && cret1 && cret2;
 }
 
+// system calls read and write user pages that are swapped
+// out, which the kernel faults back in instead of failing.
+int test_syscall_swapped(void){
+    int NPAGES = 32;
+    char *memo = malloc(PGSIZE*NPAGES);
+    char buf[64];
+    int i,j,fd,old,fds[2];
+    uint all_pass = 1;
+
+    if(memo == 0 || pipe(fds) < 0)
+        return 0;
+    old = setrss(8);
+    for(i = 0 ; i < NPAGES ; i++)
+        memset(&memo[i*PGSIZE], 'a' + i%26, PGSIZE);
+    // the first pages are long evicted by now.
+    all_pass &= (write(fds[1], &memo[0], 64) == 64);
+    all_pass &= (read(fds[0], &memo[PGSIZE], 64) == 64);
+    for(i = 0 ; i < 64 ; i++)
+        all_pass &= (memo[PGSIZE+i] == 'a');
+    memset(&memo[PGSIZE], 'b', 64);
+    close(fds[0]);
+    close(fds[1]);
+
+    // a write() bigger than the resident set.
+    if((fd = open("swtest", O_CREATE|O_RDWR)) < 0){
+        setrss(old);
+        return 0;
+    }
+    all_pass &= (write(fd, memo, PGSIZE*NPAGES) == PGSIZE*NPAGES);
+    close(fd);
+    if((fd = open("swtest", O_RDONLY)) < 0){
+        setrss(old);
+        return 0;
+    }
+    for(i = 0 ; i < NPAGES ; i++){
+        all_pass &= (read(fd, buf, sizeof(buf)) == sizeof(buf));
+        for(j = 0 ; j < sizeof(buf) ; j++)
+            all_pass &= (buf[j] == 'a' + i%26);
+        all_pass &= (read(fd, memo, PGSIZE - sizeof(buf)) == PGSIZE - sizeof(buf));
+    }
+    close(fd);
+    unlink("swtest");
+    setrss(old);
+    free(memo);
+    return all_pass;
+}
+
+// read-mostly pages are evicted without a write, from the slot
+// they were loaded from. they must still read back right, also
+// after some of them are written to again.
+int test_clean_evict(void){
+    int NPAGES = 24;
+    char *memo = malloc(PGSIZE*NPAGES);
+    struct vmstat before, after;
+    int i,j;
+    uint all_pass = 1;
+
+    for(i = 0 ; i < NPAGES ; i++)
+        memo[i*PGSIZE] = (char)i;
+
+    // after the first pass, pages come back in from their slots
+    // and are only read, so they must leave without a write. only
+    // pages resident, and maybe dirty, at "before" may cost one.
+    for(j = 0 ; j < 5 ; j++){
+        if(j == 1)
+            all_pass &= (getvmstat(getpid(), &before) == 0);
+        for(i = 0 ; i < NPAGES ; i++)
+            all_pass &= (memo[i*PGSIZE] == (char)i);
+    }
+    all_pass &= (getvmstat(getpid(), &after) == 0);
+    if(all_pass && after.swap_ins > before.swap_ins){
+        all_pass &= (after.clean_evictions > before.clean_evictions);
+        all_pass &= (after.swap_outs - before.swap_outs <= before.resident);
+    }
+
+    for(i = 0 ; i < NPAGES ; i += 3)
+        memo[i*PGSIZE] = (char)(i+100);
+
+    for(j = 0 ; j < 3 ; j++){
+        for(i = 0 ; i < NPAGES ; i++){
+            if(i%3 == 0)
+                all_pass &= (memo[i*PGSIZE] == (char)(i+100));
+            else
+                all_pass &= (memo[i*PGSIZE] == (char)i);
+        }
+    }
+    free(memo);
+    return all_pass;
+}
+
+// a process far bigger than the old 32-page limit, first
+// squeezed into a small resident set, then given more room.
+int test_big_proc(void){
+    int NPAGES = 300;
+    char *memo = malloc(PGSIZE*NPAGES);
+    int i,old;
+    uint all_pass = 1;
+    struct vmstat st;
+
+    if(memo == 0)
+        return 0;
+    old = setrss(8);
+    for(i = 0 ; i < NPAGES ; i++)
+        memo[i*PGSIZE] = (char)i;
+    if(getvmstat(getpid(), &st) < 0)
+        return 0;
+    all_pass &= (st.resident <= 8 && st.swapped >= NPAGES-8 && st.swap_outs > 0);
+    for(i = 0 ; i < NPAGES ; i++)
+        all_pass &= (memo[i*PGSIZE] == (char)i);
+
+    setrss(64);
+    for(i = NPAGES-1 ; i >= 0 ; i--)
+        all_pass &= (memo[i*PGSIZE] == (char)i);
+    all_pass &= (setrss(0) < 0);
+
+    setrss(old);
+    free(memo);
+    return all_pass;
+}
+
+// parent and child share the pages after fork until one of
+// them writes, from user mode or through a system call.
+int test_cow(void){
+    int NPAGES = 8;
+    char *memo = malloc(PGSIZE*NPAGES);
+    int i,pid,status,fds[2];
+    uint all_pass = 1;
+
+    for(i = 0 ; i < NPAGES ; i++)
+        memo[i*PGSIZE] = (char)i;
+    if(pipe(fds) < 0 || (pid = fork()) < 0){
+        printf("FAILED - fork\n");
+        return 0;
+    }
+    if(pid == 0){
+        for(i = 0 ; i < NPAGES ; i += 2)
+            memo[i*PGSIZE] = (char)(i+50);
+        write(fds[1], "x", 1);
+        for(i = 0 ; i < NPAGES ; i++){
+            if(memo[i*PGSIZE] != (char)(i%2 ? i : i+50))
+                exit(1);
+        }
+        exit(0);
+    }
+    // read() writes into a shared page from the kernel.
+    if(read(fds[0], &memo[PGSIZE+1], 1) != 1 || memo[PGSIZE+1] != 'x')
+        all_pass = 0;
+    wait(&status);
+    all_pass &= (status == 0);
+    for(i = 0 ; i < NPAGES ; i++)
+        all_pass &= (memo[i*PGSIZE] == (char)i);
+    close(fds[0]);
+    close(fds[1]);
+    free(memo);
+    return all_pass;
+}
+
+// two processes page side by side under different policies,
+// and one switches policy with pages resident and swapped.
+int test_policy(void){
+    int NPAGES = 24;
+    char *memo = malloc(PGSIZE*NPAGES);
+    struct vmstat st;
+    int i,j,pid,status;
+    uint all_pass = 1;
+
+    // the policy this process started with, put back at the end.
+    if(memo == 0 || getvmstat(getpid(), &st) < 0)
+        return 0;
+    all_pass &= (setpolicy("nosuch") < 0);
+    all_pass &= (setpolicy("nfua") == 0);
+    for(i = 0 ; i < NPAGES ; i++)
+        memo[i*PGSIZE] = (char)i;
+    if((pid = fork()) < 0){
+        printf("FAILED - fork\n");
+        setpolicy(st.policy);
+        free(memo);
+        return 0;
+    }
+    if(pid == 0 && setpolicy("scfifo") < 0)
+        exit(1);
+    for(j = 0 ; j < 4 ; j++){
+        if(j == 2 && setpolicy(pid == 0 ? "clockpro" : "lapa") < 0)
+            all_pass = 0;
+        for(i = 0 ; i < NPAGES ; i++)
+            all_pass &= (memo[i*PGSIZE] == (char)i);
+    }
+    if(pid == 0)
+        exit(!all_pass);
+    wait(&status);
+    all_pass &= (status == 0);
+    setpolicy(st.policy);
+    free(memo);
+    return all_pass;
+}
+
 struct test {
     int (*f)(void);
     char *s;
   } tests[] = {
     {test1,"test1"},
     {test_fork, "test_fork"},
+    {test_syscall_swapped, "test_syscall_swapped"},
+    {test_clean_evict, "test_clean_evict"},
+    {test_big_proc, "test_big_proc"},
+    {test_cow, "test_cow"},
+    {test_policy, "test_policy"},
     { 0, 0}, 
   };
 
@@ -1,5 +1,6 @@
 struct stat;
 struct rtcdate;
+struct vmstat;
 
 // system calls
 int fork(void);
@@ -23,6 +24,10 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int getvmstat(int, struct vmstat*);
+int setrss(int);
+int setpolicy(char*);
+int getvmstats(struct vmstat*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
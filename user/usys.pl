@@ -36,3 +36,7 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("getvmstat");
+entry("setrss");
+entry("setpolicy");
+entry("getvmstats");
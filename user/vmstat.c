@@ -0,0 +1,123 @@
+// Report paging activity every N ticks: system-wide swap
+// usage and I/O, then one line per process with its resident
+// and swapped pages and what it faulted, loaded, stored and
+// evicted clean since the previous report.
+//
+// usage: vmstat [ticks [count]]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/vmstat.h"
+#include "user/user.h"
+
+struct vmstat cur[NPROC], prev[NPROC];
+int ncur, nprev;
+
+// Counters of pid at the previous report, or 0 if it is new.
+static struct vmstat*
+lookup(int pid)
+{
+  int i;
+
+  for(i = 0; i < nprev; i++)
+    if(prev[i].pid == pid)
+      return &prev[i];
+  return 0;
+}
+
+static int
+avg(uint64 time, uint64 n)
+{
+  return n ? (int)(time / n) : 0;
+}
+
+static void
+report(int ticks)
+{
+  static struct vmstat zero;
+  struct vmstat *s, *o;
+  int i, reads, writes;
+
+  if(ncur == 0)
+    return;
+  s = &cur[0];
+  o = nprev ? &prev[0] : &zero;
+  reads = s->swap_reads - o->swap_reads;
+  writes = s->swap_writes - o->swap_writes;
+  printf("%d free pages, %d/%d swap slots used\n",
+         s->free_pages, s->swap_slots - s->swap_free, s->swap_slots);
+  if(nprev)
+    printf("last %d ticks: ", ticks);
+  else
+    printf("since boot: ");
+  printf("%d swap reads (%d cycles), %d swap writes (%d cycles)\n",
+         reads, avg(s->swap_read_time - o->swap_read_time, reads),
+         writes, avg(s->swap_write_time - o->swap_write_time, writes));
+  printf("kalloc: %d refills, %d steals, %d spills, %d contended\n",
+         (int)(s->kalloc_refills - o->kalloc_refills),
+         (int)(s->kalloc_steals - o->kalloc_steals),
+         (int)(s->kalloc_spills - o->kalloc_spills),
+         (int)(s->kalloc_contended - o->kalloc_contended));
+  printf("free blocks:");
+  for(i = 0; i < KORDERS; i++)
+    printf(" %d", s->free_blocks[i]);
+  printf(" (of 1..%d pages)\n", 1 << (KORDERS-1));
+  printf("slab: %d pages\n", s->slab_pages);
+  printf("bcache: %d buffers, %d hits, %d misses, %d contended\n", s->nbuf,
+         (int)(s->bcache_hits - o->bcache_hits),
+         (int)(s->bcache_misses - o->bcache_misses),
+         (int)(s->bcache_contended - o->bcache_contended));
+  printf("zeroed: %d pages, %d hits, %d misses\n", s->zeroed_pages,
+         (int)(s->zeroed_hits - o->zeroed_hits),
+         (int)(s->zeroed_misses - o->zeroed_misses));
+  printf("pid\trss\tswap\tfaults\tins\touts\tclean\tld-cyc\tst-cyc\tname\n");
+  for(i = 0; i < ncur; i++){
+    s = &cur[i];
+    if((o = lookup(s->pid)) == 0)
+      o = &zero;
+    printf("%d\t%d/%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%s\n",
+           s->pid, s->resident, s->rss_limit, s->swapped,
+           (int)(s->faults - o->faults),
+           (int)(s->swap_ins - o->swap_ins),
+           (int)(s->swap_outs - o->swap_outs),
+           (int)(s->clean_evictions - o->clean_evictions),
+           avg(s->load_time - o->load_time, s->swap_ins - o->swap_ins),
+           avg(s->store_time - o->store_time,
+               s->swap_outs - o->swap_outs + s->clean_evictions - o->clean_evictions),
+           s->name);
+  }
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int interval = 100, count = -1;
+  int t0, t;
+
+  if(argc > 1)
+    interval = atoi(argv[1]);
+  if(argc > 2)
+    count = atoi(argv[2]);
+  if(interval < 1){
+    fprintf(2, "usage: vmstat [ticks [count]]\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  for(;;){
+    if((ncur = getvmstats(cur, NPROC)) < 0){
+      fprintf(2, "vmstat: getvmstats failed\n");
+      exit(1);
+    }
+    t = uptime();
+    report(t - t0);
+    if(count > 0 && --count == 0)
+      break;
+    memmove(prev, cur, sizeof(cur));
+    nprev = ncur;
+    t0 = t;
+    sleep(interval);
+  }
+  exit(0);
+}
@@ -0,0 +1,93 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// Write a file sequentially, KB kilobytes of it (default 256),
+// in chunks of each size from one block up to 64, past the
+// most a write() commits in one transaction, and report KB written
+// per tick. Each transaction goes to the disk twice, to the
+// log and then home, so this measures how fast the log gets
+// a batch of blocks to the disk.
+//
+// Then have 1 up to N processes (default 4) write KB between
+// them, a block per write() to a file each, which is bound by
+// how many of their writes share a commit.
+
+char buf[64*BSIZE];
+
+static void
+writer(int i, int kb)
+{
+  char path[16];
+  int fd, n;
+
+  strcpy(path, "writebench0");
+  path[10] = '0' + i;
+  if((fd = open(path, O_CREATE|O_TRUNC|O_WRONLY)) < 0)
+    exit(1);
+  for(n = 0; n < kb; n++){
+    if(write(fd, buf, BSIZE) != BSIZE)
+      exit(1);
+  }
+  close(fd);
+  unlink(path);
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 256, max = 4, chunk, n, i, fd, t0, t, status, ok;
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(argc > 2)
+    max = atoi(argv[2]);
+  if(kb < 1 || kb > MAXFILE*BSIZE/1024 || max < 1 || max > 10){
+    fprintf(2, "usage: writebench [KB [nprocs]]\n");
+    exit(1);
+  }
+  memset(buf, 'w', sizeof(buf));
+
+  for(chunk = BSIZE; chunk <= sizeof(buf); chunk *= 2){
+    if((fd = open("writebench.tmp", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+      fprintf(2, "writebench: cannot create file\n");
+      exit(1);
+    }
+    t0 = uptime();
+    for(n = 0; n < kb*1024; n += chunk){
+      if(write(fd, buf, chunk) != chunk){
+        fprintf(2, "writebench: write failed\n");
+        exit(1);
+      }
+    }
+    close(fd);
+    t = uptime() - t0;
+    printf("%d-byte writes: %d KB in %d ticks, %d KB per tick\n",
+           chunk, kb, t, kb / (t ? t : 1));
+    unlink("writebench.tmp");
+  }
+
+  for(n = 1; n <= max; n++){
+    t0 = uptime();
+    for(i = 0; i < n; i++){
+      if(fork() == 0)
+        writer(i, kb / n);
+    }
+    ok = 1;
+    for(i = 0; i < n; i++){
+      if(wait(&status) < 0 || status != 0)
+        ok = 0;
+    }
+    t = uptime() - t0;
+    if(!ok){
+      printf("writebench: %d procs: FAILED\n", n);
+      exit(1);
+    }
+    printf("%d procs: %d KB in %d ticks, %d KB per tick\n",
+           n, n * (kb / n), t, n * (kb / n) / (t ? t : 1));
+  }
+  exit(0);
+}